@@ -0,0 +1,302 @@
+// StringAlgosBench - the wall clock benchmark of the engines, the results are written as JSON:
+//     StringAlgosBench --engine aho,hyperscan --corpus resources/war_peace --dict sample:1000:4-16 --runs 10
+//     StringAlgosBench --corpus dpi:256M:64-1500 --dict dpi:10000:0.05 --buffer packets
+// see `Usage` for the options and harness.h for the measurements.
+
+#include <iostream>
+#include <fstream>
+
+#include <harness.h>
+
+using namespace std;
+using namespace StringAlgos;
+using namespace StringAlgos::Bench;
+
+namespace {
+
+const char * kDefaultEngines = "trie,aho,aho-lazy,aho-sparse,aho-hybrid,flat-aho,hyperscan,hybrid";
+
+struct Options {
+    string engines = kDefaultEngines;
+    string corpus = "random:64M:26";
+    string dict = "random:1000:4-16:26";
+    size_t runs = 5;
+    size_t warmup = 1;
+    size_t threads = 1;
+    size_t buffer = 512;
+    bool packets = false; // the latencies of the packets of the dpi corpus instead of the buffers
+    size_t samples = 100000;
+    unsigned seed = 1;
+    string out;
+};
+
+void Usage() {
+    cerr << "usage: StringAlgosBench [options]" << endl
+         << "  --engine NAMES    comma separated names, `all` or the default " << kDefaultEngines << endl
+         << "  --list            print the names of the engines" << endl
+         << "  --corpus SPEC     a file, random:SIZE[:ALPHABET] or dpi:SIZE[:MIN-MAX] (packets of MIN-MAX bytes,"  << endl
+         << "                    64-1500 by default, see workload.h), default random:64M:26" << endl
+         << "  --dict SPEC       a file with a pattern per line, random:COUNT[:MIN-MAX[:ALPHABET]],"  << endl
+         << "                    sample:COUNT[:MIN-MAX] (substrings of the corpus) or dpi:COUNT[:HIT_RATIO]"  << endl
+         << "                    (rules, 0.1 of them drawn from the traffic by default), default random:1000:4-16:26" << endl
+         << "  --runs N          timed scans of the corpus, default 5" << endl
+         << "  --warmup N        untimed scans before them, default 1" << endl
+         << "  --threads N       threads which scan the corpus at once, default 1" << endl
+         << "  --buffer SIZE     the buffers of the latency percentiles, 0 disables them, default 512;" << endl
+         << "                    `packets` takes the packets of the dpi corpus" << endl
+         << "  --samples N       the number of the timed buffers, default 100000" << endl
+         << "  --seed N          of the random corpus and dictionary, default 1" << endl
+         << "  --out FILE        the JSON output, stdout by default" << endl;
+}
+
+bool ParseArgs(int argc, char ** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--list") {
+            for (const auto& e: Engines()) {
+                cout << e.first << endl;
+            }
+            exit(0);
+        }
+
+        if (arg == "--help" || arg == "-h" || i + 1 == argc) {
+            return false;
+        }
+
+        string value = argv[++i];
+        bool ok = true;
+        if (arg == "--engine") {
+            o.engines = value;
+        } else if (arg == "--corpus") {
+            o.corpus = value;
+        } else if (arg == "--dict") {
+            o.dict = value;
+        } else if (arg == "--runs") {
+            ok = ParseSize(value, o.runs) && o.runs > 0;
+        } else if (arg == "--warmup") {
+            ok = ParseSize(value, o.warmup);
+        } else if (arg == "--threads") {
+            ok = ParseSize(value, o.threads) && o.threads > 0;
+        } else if (arg == "--buffer") {
+            o.packets = value == "packets";
+            ok = o.packets || ParseSize(value, o.buffer);
+        } else if (arg == "--samples") {
+            ok = ParseSize(value, o.samples);
+        } else if (arg == "--seed") {
+            size_t seed;
+            ok = ParseSize(value, seed);
+            o.seed = (unsigned) seed;
+        } else if (arg == "--out") {
+            o.out = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            cerr << "bad option " << arg << " " << value << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// `packets` are filled for the dpi corpus
+bool LoadCorpus(const string& spec, mt19937& rnd, DpiGenerator& dpi, string& text, vector<Piece>& packets) {
+    vector<string> parts = Split(spec, ':');
+    if (!parts.empty() && parts[0] == "dpi") {
+        size_t size = 0, minPacket = 64, maxPacket = 1500;
+        if (parts.size() < 2 || parts.size() > 3 || !ParseSize(parts[1], size)
+                || (parts.size() == 3 && !ParseRange(parts[2], minPacket, maxPacket))) {
+            return false;
+        }
+
+        JoinPackets(dpi.Packets(size, minPacket, maxPacket), text, packets);
+        return true;
+    }
+
+    if (parts.empty() || parts[0] != "random") {
+        return ReadFile(spec, text);
+    }
+
+    size_t size = 0, alphabet = 26;
+    if (parts.size() < 2 || parts.size() > 3 || !ParseSize(parts[1], size)
+            || (parts.size() == 3 && !ParseSize(parts[2], alphabet))) {
+        return false;
+    }
+
+    text = RandomText(size, alphabet, rnd);
+    return true;
+}
+
+bool LoadDict(const string& spec, const string& text, mt19937& rnd, DpiGenerator& dpi, vector<string>& dict) {
+    vector<string> parts = Split(spec, ':');
+    if (!parts.empty() && parts[0] == "dpi") {
+        size_t count = 0;
+        double hitRatio = parts.size() == 3 ? atof(parts[2].c_str()) : 0.1;
+        if (parts.size() < 2 || parts.size() > 3 || !ParseSize(parts[1], count) || hitRatio < 0 || hitRatio > 1) {
+            return false;
+        }
+
+        dict = dpi.Rules(count, hitRatio);
+        return true;
+    }
+
+    if (parts.empty() || (parts[0] != "random" && parts[0] != "sample")) {
+        return ReadLines(spec, dict);
+    }
+
+    size_t count = 0, minLen = 4, maxLen = 16, alphabet = 26;
+    if (parts.size() < 2 || !ParseSize(parts[1], count)
+            || (parts.size() > 2 && !ParseRange(parts[2], minLen, maxLen))) {
+        return false;
+    }
+
+    if (parts[0] == "sample") {
+        dict = SampleDict(text, count, minLen, maxLen, rnd);
+        return parts.size() <= 3 && !dict.empty();
+    }
+
+    if (parts.size() > 4 || (parts.size() == 4 && !ParseSize(parts[3], alphabet))) {
+        return false;
+    }
+
+    dict = RandomDict(count, minLen, maxLen, alphabet, rnd);
+    return true;
+}
+
+void RunEngine(const string& name, const EngineFactory& factory, const vector<string>& dict, const string& text,
+               const vector<Piece>& pieces, const Options& o, JsonWriter& json) {
+    cerr << name << "..." << endl;
+    EnginePtr ps = factory();
+
+    size_t inserted = 0;
+    Stopwatch insertWatch;
+    for (size_t i = 0; i < dict.size(); ++i) {
+        inserted += ps->Insert(dict[i], (int) i);
+    }
+    double insertSeconds = insertWatch.Seconds();
+
+    Stopwatch buildWatch;
+    ps->Build();
+    double buildSeconds = buildWatch.Seconds();
+
+    size_t found = 0;
+    for (size_t i = 0; i < o.warmup; ++i) {
+        TimeScan(*ps, text, o.threads, found);
+    }
+
+    vector<double> seconds;
+    for (size_t i = 0; i < o.runs; ++i) {
+        seconds.push_back(TimeScan(*ps, text, o.threads, found));
+    }
+
+    Summary s = Summarize(seconds);
+    double bytes = double(text.size()) * o.threads;
+    vector<double> latencies = Latencies(*ps, text, pieces, o.samples);
+
+    json.BeginObject();
+    json.Key("engine").Value(name);
+    json.Key("inserted").Value(inserted);
+    json.Key("insert_seconds").Value(insertSeconds);
+    json.Key("build_seconds").Value(buildSeconds);
+    json.Key("memory_bytes").Value(ps->MemoryUsage().Total());
+    json.Key("found").Value(found);
+
+    json.Key("scan_seconds").BeginObject();
+    json.Key("min").Value(s.min);
+    json.Key("median").Value(s.median);
+    json.Key("mean").Value(s.mean);
+    json.Key("max").Value(s.max);
+    json.Key("runs").BeginArray();
+    for (double t: seconds) {
+        json.Value(t);
+    }
+    json.EndArray();
+    json.EndObject();
+
+    // by the median run
+    json.Key("mb_per_s").Value(bytes / 1e6 / s.median);
+    json.Key("ns_per_byte").Value(s.median * 1e9 / bytes);
+
+    json.Key("latency_ns").BeginObject();
+    json.Key("buffer").Value(!o.packets ? o.buffer : text.size() / std::max<size_t>(1, pieces.size()));
+    json.Key("packets").Value(o.packets);
+    json.Key("samples").Value(latencies.size());
+    json.Key("p50").Value(Percentile(latencies, 50));
+    json.Key("p90").Value(Percentile(latencies, 90));
+    json.Key("p99").Value(Percentile(latencies, 99));
+    json.Key("max").Value(Percentile(latencies, 100));
+    json.EndObject();
+    json.EndObject();
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    Options o;
+    if (!ParseArgs(argc, argv, o)) {
+        Usage();
+        return 1;
+    }
+
+    vector<pair<string, EngineFactory>> engines;
+    if (!SelectEngines(o.engines, engines)) {
+        cerr << "unknown engine in " << o.engines << ", see --list" << endl;
+        return 1;
+    }
+
+    mt19937 rnd(o.seed);
+    DpiGenerator dpi(o.seed);
+    string text;
+    vector<Piece> packets;
+    if (!LoadCorpus(o.corpus, rnd, dpi, text, packets) || text.empty()) {
+        cerr << "can't load the corpus " << o.corpus << endl;
+        return 1;
+    }
+
+    if (o.packets && packets.empty()) {
+        cerr << "--buffer packets needs the dpi corpus" << endl;
+        return 1;
+    }
+
+    vector<string> dict;
+    if (!LoadDict(o.dict, text, rnd, dpi, dict) || dict.empty()) {
+        cerr << "can't load the dictionary " << o.dict << endl;
+        return 1;
+    }
+
+    ofstream file;
+    if (!o.out.empty()) {
+        file.open(o.out);
+        if (!file) {
+            cerr << "can't open " << o.out << endl;
+            return 1;
+        }
+    }
+
+    JsonWriter json(o.out.empty() ? cout : file);
+    json.BeginObject();
+    json.Key("corpus").BeginObject();
+    json.Key("spec").Value(o.corpus);
+    json.Key("bytes").Value(text.size());
+    json.EndObject();
+    json.Key("dict").BeginObject();
+    json.Key("spec").Value(o.dict);
+    json.Key("patterns").Value(dict.size());
+    json.EndObject();
+    json.Key("runs").Value(o.runs);
+    json.Key("warmup").Value(o.warmup);
+    json.Key("threads").Value(o.threads);
+    json.Key("seed").Value(o.seed);
+
+    json.Key("results").BeginArray();
+    for (const auto& e: engines) {
+        RunEngine(e.first, e.second, dict, text, o.packets ? packets : FixedPieces(text.size(), o.buffer), o, json);
+    }
+    json.EndArray();
+    json.EndObject();
+
+    (o.out.empty() ? cout : file) << endl;
+    return 0;
+}
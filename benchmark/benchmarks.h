@@ -34,6 +34,7 @@
 #include <algorithm>
 #include <PatternSearch.h>
 #include <iomanip>
+#include <workload.h>
 
 namespace {
 
@@ -112,6 +113,16 @@ PatternHandler patternHandler;
 using namespace StringAlgos;
 using namespace std;
 
+// memory(name) - MemoryUsage of the built engine in KB by category
+template<class PatternSearchT>
+void PrintMemory(const PatternSearchT& ps, const char * name) {
+    MemoryStats m = ps.MemoryUsage();
+    cerr << "  memory(" << name << "): " << m.Total() / 1024 << " KB"
+         << " (states " << m.states / 1024 << ", transitions " << m.transitions / 1024
+         << ", outputs " << m.outputs / 1024 << ", patterns " << m.patterns / 1024
+         << ", database " << m.database / 1024 << ", scratch " << m.scratch / 1024 << ")" << endl;
+}
+
 template<class PatternSearchT>
 void BM_INSERT() {
     PatternSearchT ps;
@@ -156,6 +167,7 @@ void BM_BUILD() {
     ps.Build();
 
     cerr << "  BM_BUILD: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+    PrintMemory(ps, "build");
 }
 
 PatternSearchBenchmark psb;
@@ -233,10 +245,354 @@ void BM_RANDOM_FIND() {
     double start = clock();
     cerr << "  cnt: " << ps.Find(text).size() << endl;
     cerr << "  BM_RANDOM_FIND: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+    PrintMemory(ps, "random");
 }
 
 int x = generator();
 
+// BM_SCAN_STATS_FIND - BM_RANDOM_FIND with the counters of the scan loops (they are zeros without SCAN_STATS=y)
+// and the hardware counters of the scan
+template<class PatternSearchT>
+void BM_SCAN_STATS() {
+    PatternSearchT ps;
+
+    for (size_t i = 0; i < words.size(); ++i) {
+        ps.Insert(words[i], i);
+    }
+    ps.Build();
+
+    ResetScanStats();
+    PerfCounters counters;
+
+    double start = clock();
+    counters.Start();
+    size_t cnt = ps.Find(text).size();
+    counters.Stop();
+
+    cerr << "  cnt: " << cnt << endl;
+    cerr << "  BM_SCAN_STATS_FIND: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    ScanStats stats = ThreadScanStats();
+    cerr << "  scan stats: bytes " << stats.bytes << ", root " << stats.rootBytes << ", links " << stats.linkSteps
+         << ", output links " << stats.outputLinks << ", matches " << stats.matches << ", early exits " << stats.earlyExits << endl;
+
+    if (counters.Valid()) {
+        cerr << "  cache misses: " << counters.CacheMisses() << ", branch misses: " << counters.BranchMisses() << endl;
+    } else {
+        cerr << "  perf counters aren't available" << endl;
+    }
+}
+
+// the same dictionary is compiled with the given options, e.g. as regexs and as literals
+template<class PatternSearchT>
+void BM_OPTIONS(const PatternOptions& options, const char * name) {
+    PatternSearchT ps;
+
+    for (size_t i = 0; i < patternHandler.patterns.size(); ++i) {
+        ps.Insert(patternHandler.patterns[i], i, options);
+    }
+
+    // the text is english, so a cyrillic pattern is needed to switch on the utf-8 folding
+    if (options.Has(PatternOptions::kUtf8)) {
+        ps.Insert("\xd0\x9c\xd0\xb8\xd1\x80", patternHandler.patterns.size(), options);
+    }
+
+    double start = clock();
+
+    ps.Build();
+
+    cerr << "  BM_BUILD(" << name << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    cerr << "  cnt: " << ps.Find(text).size() << endl;
+    cerr << "  BM_RANDOM_FIND(" << name << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+    PrintMemory(ps, name);
+}
+
+template<template <typename> class PatternSearchT>
+void startLiteralBM() {
+    BM_OPTIONS<PatternSearchT<int>>(PatternOptions(), "regex");
+    BM_OPTIONS<PatternSearchT<int>>(PatternOptions(PatternOptions::kLiteral), "literal");
+}
+
+// BM_RANDOM_FIND of the case folding modes, the text is mostly ascii
+template<template <typename> class PatternSearchT>
+void startCaseBM() {
+    BM_OPTIONS<PatternSearchT<int>>(PatternOptions(), "bytes");
+    BM_OPTIONS<PatternSearchT<int>>(PatternOptions(PatternOptions::kCaseless), "caseless");
+    BM_OPTIONS<PatternSearchT<int>>(PatternOptions(PatternOptions::kCaseless | PatternOptions::kUtf8), "utf-8 caseless");
+}
+
+// BM_LAYOUT_BUILD/BM_LAYOUT_FIND - the random dictionary with the given layout of transitions,
+// rows - memory of the rows of transitions after the scan, bytes/state - memory of the whole automaton per state
+template<class PatternSearchT>
+void BM_LAYOUT(const AhoLayout& layout, const char * name) {
+    PatternSearchT ps(PatternOptions(), layout);
+
+    for (size_t i = 0; i < patternHandler.patterns.size(); ++i) {
+        ps.Insert(patternHandler.patterns[i], i);
+    }
+
+    double start = clock();
+
+    ps.Build();
+
+    cerr << "  BM_LAYOUT_BUILD(" << name << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    cerr << "  cnt: " << ps.Find(text).size() << endl;
+    cerr << "  BM_LAYOUT_FIND(" << name << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+    cerr << "  rows(" << name << "): " << ps.Rows() * PatternSearchT::kRowSize / double(1 << 20) << " MB" << endl;
+    cerr << "  states(" << name << "): " << ps.States() << " x " << ps.TransitionMemory() / ps.States() << " bytes/state" << endl;
+    PrintMemory(ps, name);
+}
+
+template<template <typename> class PatternSearchT>
+void startLayoutBM() {
+    BM_LAYOUT<PatternSearchT<int>>(AhoLayout::Dense(), "dense");
+    BM_LAYOUT<PatternSearchT<int>>(AhoLayout::Lazy(), "lazy");
+    BM_LAYOUT<PatternSearchT<int>>(AhoLayout::Lazy(1 << 20), "lazy 1MB");
+    BM_LAYOUT<PatternSearchT<int>>(AhoLayout::Sparse(), "sparse");
+    BM_LAYOUT<PatternSearchT<int>>(AhoLayout::Hybrid(), "hybrid");
+}
+
+// BM_LONG_BUILD/BM_LONG_FIND - 1000 patterns of 256 bytes, only the first `maxKeyLen` bytes of them are in the trie
+template<class PatternSearchT>
+void BM_LONG(size_t maxKeyLen) {
+    PatternSearchT ps(PatternOptions(), AhoLayout::Dense(), maxKeyLen);
+
+    for (int i = 0; i < 1000; ++i) {
+        std::string p;
+        for (int j = 0; j < 256; ++j) {
+            p.push_back(char('a' + rand() % 26));
+        }
+
+        ps.Insert(p, i);
+    }
+
+    double start = clock();
+
+    ps.Build();
+
+    cerr << "  BM_LONG_BUILD(" << maxKeyLen << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+    cerr << "  states(" << maxKeyLen << "): " << ps.States() << ", " << ps.TransitionMemory() / double(1 << 20) << " MB" << endl;
+
+    start = clock();
+
+    cerr << "  cnt: " << ps.Find(text).size() << endl;
+    cerr << "  BM_LONG_FIND(" << maxKeyLen << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+}
+
+template<template <typename> class PatternSearchT>
+void startLongBM() {
+    BM_LONG<PatternSearchT<int>>(SIZE_MAX);
+    BM_LONG<PatternSearchT<int>>(16);
+}
+
+// BM_STATIC_FIND - the fixed dictionary built by the compiler, BM_STATIC_RUNTIME_FIND - the same dictionary in the engine
+template<class PatternSearchT>
+void BM_STATIC() {
+    static constexpr auto keywords = MakeStaticAho("CHAPTER", "reward", "Pierre", "Natasha", "Moscow", "war", "peace");
+    const char * patterns[] = {"CHAPTER", "reward", "Pierre", "Natasha", "Moscow", "war", "peace"};
+
+    PatternSearchT ps;
+    for (size_t i = 0; i < keywords.Size(); ++i) {
+        ps.Insert(patterns[i], i);
+    }
+    ps.Build();
+
+    double start = clock();
+
+    cerr << "  cnt: " << keywords.Find(text).size() << endl;
+    cerr << "  BM_STATIC_FIND: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    cerr << "  cnt: " << ps.Find(text).size() << endl;
+    cerr << "  BM_STATIC_RUNTIME_FIND: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+}
+
+// BM_POLICY_VIRTUAL_FIND - Find of the engine by the virtual interface,
+// BM_POLICY_SET_FIND - FlatAho by the same interface (PolicySearch), BM_POLICY_COUNT_SCAN - FlatAho into CountSink,
+// BM_POLICY_COMPACT16_SCAN - narrow rows of CompactAlphabet and uint16_t states into CountSink
+template<class PatternSearchT>
+void BM_POLICY() {
+    PatternSearchT ps;
+    PolicySearch<FlatAho<int>> flat;
+    FlatAho<int, CompactAlphabet<>, uint16_t> compact;
+
+    for (size_t i = 0; i < patternHandler.patterns.size(); ++i) {
+        const string& p = patternHandler.patterns[i];
+        ps.Insert(p, i);
+        flat.Insert(p, i);
+        compact.Insert(p.c_str(), p.size(), i);
+    }
+    ps.Build();
+    flat.Build();
+    compact.Build();
+
+    double start = clock();
+
+    cerr << "  cnt: " << ps.Find(text).size() << endl;
+    cerr << "  BM_POLICY_VIRTUAL_FIND: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    cerr << "  cnt: " << flat.Find(text).size() << endl;
+    cerr << "  BM_POLICY_SET_FIND: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    CountSink count;
+    flat.Engine().Scan(text.data(), text.size(), count);
+    cerr << "  matches: " << count.Result() << endl;
+    cerr << "  BM_POLICY_COUNT_SCAN: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    CountSink compactCount;
+    compact.Scan(text.data(), text.size(), compactCount);
+    cerr << "  matches: " << compactCount.Result() << ", states: " << compact.States() << endl;
+    cerr << "  BM_POLICY_COMPACT16_SCAN: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+}
+
+// BM_REBUILD - Build after a change of the single rule in the compiled dictionary,
+// only the shard of the changed rule is recompiled
+template<class PatternSearchT>
+void BM_REBUILD(size_t shards) {
+    PatternSearchT ps(PatternOptions(), shards);
+
+    for (size_t i = 0; i < patternHandler.patterns.size(); ++i) {
+        ps.Insert(patternHandler.patterns[i], i);
+    }
+    ps.Build();
+
+    ps.Delete(patternHandler.patterns[0], 0);
+
+    double start = clock();
+
+    ps.Build();
+
+    cerr << "  BM_REBUILD(" << shards << " shards): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+}
+
+template<template <typename> class PatternSearchT>
+void startShardsBM() {
+    BM_REBUILD<PatternSearchT<int>>(1);
+    BM_REBUILD<PatternSearchT<int>>(4);
+    BM_REBUILD<PatternSearchT<int>>(16);
+}
+
+// BM_MIXED_BUILD/BM_MIXED_FIND - dictionary where every 10th pattern is a regex, the rest are literals
+template<class PatternSearchT>
+void BM_MIXED() {
+    PatternSearchT ps;
+
+    for (size_t i = 0; i < patternHandler.patterns.size(); ++i) {
+        const string& p = patternHandler.patterns[i];
+
+        if (i % 10 == 0) {
+            ps.Insert(p.substr(0, p.size() / 2) + "[a-z]+" + p.substr(p.size() / 2), i);
+        } else {
+            ps.Insert(p, i);
+        }
+    }
+
+    double start = clock();
+
+    ps.Build();
+
+    cerr << "  BM_MIXED_BUILD: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    cerr << "  cnt: " << ps.Find(text).size() << endl;
+    cerr << "  BM_MIXED_FIND: " << (clock() - start) / CLOCKS_PER_SEC << endl;
+}
+
+// BM_BULK_INSERT/BM_BULK_DELETE - maintaining of a big rule set (100k - 1M patterns), Build isn't called
+template<class PatternSearchT>
+void BM_BULK_UPDATE(int cnt_pat) {
+    const int MIN_LEN = 8;
+    const int MAX_LEN = 32;
+    const int ALPH_SIZE = 26;
+
+    vector<string> patterns;
+    patterns.reserve(cnt_pat);
+
+    for (int i = 0; i < cnt_pat; ++i) {
+        int len = MIN_LEN + rand() % (MAX_LEN - MIN_LEN + 1);
+        std::string p;
+        p.reserve(len);
+
+        for (int j = 0; j < len; ++j) {
+            p.push_back(char('a' + rand() % ALPH_SIZE));
+        }
+
+        patterns.push_back(p);
+    }
+
+    PatternSearchT ps;
+
+    double start = clock();
+
+    for (int i = 0; i < cnt_pat; ++i) {
+        ps.Insert(patterns[i], i);
+    }
+
+    cerr << "  BM_BULK_INSERT(" << cnt_pat << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+
+    start = clock();
+
+    for (int i = 0; i < cnt_pat; ++i) {
+        ps.Delete(patterns[i], i);
+    }
+
+    cerr << "  BM_BULK_DELETE(" << cnt_pat << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+}
+
+// BM_DPI_FIND - 10000 literal rules of workload.h in 64MB of http/dns/tls-like packets, `hitRatio` of the rules
+// are drawn from the vocabulary of the packets, every packet is scanned separately like in the probe
+template<class PatternSearchT>
+void BM_DPI(double hitRatio) {
+    Bench::DpiGenerator dpi(1);
+    vector<string> packets = dpi.Packets(64 << 20, 64, 1500);
+    vector<string> rules = dpi.Rules(10000, hitRatio);
+
+    PatternSearchT ps;
+    for (size_t i = 0; i < rules.size(); ++i) {
+        ps.Insert(rules[i], i, PatternOptions(PatternOptions::kLiteral));
+    }
+    ps.Build();
+
+    double start = clock();
+
+    size_t cnt = 0;
+    for (const string& p: packets) {
+        cnt += ps.Find(p).size();
+    }
+
+    cerr << "  cnt: " << cnt << endl;
+    cerr << "  BM_DPI_FIND(" << hitRatio << "): " << (clock() - start) / CLOCKS_PER_SEC << endl;
+    PrintMemory(ps, "dpi");
+}
+
+template<template <typename> class PatternSearchT>
+void startDpiBM() {
+    BM_DPI<PatternSearchT<int>>(0.01);
+    BM_DPI<PatternSearchT<int>>(0.1);
+    BM_DPI<PatternSearchT<int>>(0.5);
+}
+
+// trie based engines allocate a vertex per character, so only engines with flat rule storage are run here
+template<template <typename> class PatternSearchT>
+void startUpdateBM() {
+    BM_BULK_UPDATE<PatternSearchT<int>>(100000);
+    BM_BULK_UPDATE<PatternSearchT<int>>(1000000);
+}
+
 template<template <typename> class PatternSearchT>
 void startBM() {
     BM_INSERT<PatternSearchT<int>>();
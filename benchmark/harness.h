@@ -0,0 +1,458 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+// The harness of the `StringAlgosBench` (bench.cpp) and `StringAlgosSweep` (sweep.cpp) targets:
+// wall clock timing by steady_clock, warm-up and repeated runs, throughput and the latency percentiles
+// of the scans of small buffers. Unlike benchmarks.h nothing is done at static initialization,
+// the corpus and the dictionary are given by the command line.
+
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+
+#include <PatternSearch.h>
+#include <LinearSearch.h>
+#include <TrieSearch.h>
+#include <Aho.h>
+#include <Hyperscan.h>
+#include <HybridSearch.h>
+#include <FlatAho.h>
+#include <PolicySearch.h>
+
+#include <workload.h>
+
+namespace StringAlgos {
+namespace Bench {
+
+typedef std::unique_ptr<PatternSearch<int>> EnginePtr;
+typedef std::function<EnginePtr()> EngineFactory;
+
+// the engines by the names of the command line, Hyperscan and HybridSearch take the patterns as literals
+inline const std::vector<std::pair<std::string, EngineFactory>>& Engines() {
+    static const std::vector<std::pair<std::string, EngineFactory>> engines{
+        {"linear", [] { return EnginePtr(new LinearSearch<int>()); }},
+        {"trie", [] { return EnginePtr(new TrieSearch<int>()); }},
+        {"aho", [] { return EnginePtr(new Aho<int>()); }},
+        {"aho-lazy", [] { return EnginePtr(new Aho<int>(PatternOptions(), AhoLayout::Lazy())); }},
+        {"aho-sparse", [] { return EnginePtr(new Aho<int>(PatternOptions(), AhoLayout::Sparse())); }},
+        {"aho-hybrid", [] { return EnginePtr(new Aho<int>(PatternOptions(), AhoLayout::Hybrid())); }},
+        {"flat-aho", [] { return EnginePtr(new PolicySearch<FlatAho<int>>()); }},
+        {"hyperscan", [] { return EnginePtr(new Hyperscan<int>(PatternOptions(PatternOptions::kLiteral))); }},
+        {"hybrid", [] { return EnginePtr(new HybridSearch<int>(PatternOptions(PatternOptions::kLiteral))); }},
+    };
+
+    return engines;
+}
+
+inline double Seconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+class Stopwatch {
+public:
+    Stopwatch()
+        : _start(std::chrono::steady_clock::now())
+    {}
+
+    double Seconds() const {
+        return Bench::Seconds(std::chrono::steady_clock::now() - _start);
+    }
+
+private:
+    std::chrono::steady_clock::time_point _start;
+};
+
+// nearest rank, `p` is in [0, 100]
+inline double Percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+
+    size_t rank = (size_t) std::ceil(p / 100 * values.size());
+    size_t i = std::min(values.size() - 1, rank ? rank - 1 : 0);
+    std::nth_element(values.begin(), values.begin() + i, values.end());
+    return values[i];
+}
+
+struct Summary {
+    double min;
+    double median;
+    double max;
+    double mean;
+};
+
+inline Summary Summarize(const std::vector<double>& values) {
+    Summary s{0, 0, 0, 0};
+    if (values.empty()) {
+        return s;
+    }
+
+    s.min = *std::min_element(values.begin(), values.end());
+    s.max = *std::max_element(values.begin(), values.end());
+    s.median = Percentile(values, 50);
+    for (double v: values) {
+        s.mean += v;
+    }
+    s.mean /= values.size();
+    return s;
+}
+
+// sizes like "512", "64K", "16M", "1G"
+inline bool ParseSize(const std::string& s, size_t& size) {
+    char * end = nullptr;
+    unsigned long long value = strtoull(s.c_str(), &end, 10);
+    if (end == s.c_str()) {
+        return false;
+    }
+
+    std::string suffix(end);
+    if (suffix == "K" || suffix == "k") {
+        value <<= 10;
+    } else if (suffix == "M" || suffix == "m") {
+        value <<= 20;
+    } else if (suffix == "G" || suffix == "g") {
+        value <<= 30;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+
+    size = value;
+    return true;
+}
+
+inline std::vector<std::string> Split(const std::string& s, char delim) {
+    std::vector<std::string> res;
+    std::stringstream stream(s);
+    std::string item;
+    while (std::getline(stream, item, delim)) {
+        res.push_back(item);
+    }
+
+    return res;
+}
+
+// "4-16" or "8"
+inline bool ParseRange(const std::string& s, size_t& min, size_t& max) {
+    std::vector<std::string> parts = Split(s, '-');
+    if (parts.size() == 1) {
+        return ParseSize(parts[0], min) && ParseSize(parts[0], max) && min > 0;
+    }
+
+    return parts.size() == 2 && ParseSize(parts[0], min) && ParseSize(parts[1], max) && min > 0 && min <= max;
+}
+
+// "10,1K,1M"
+inline bool ParseSizes(const std::string& s, std::vector<size_t>& sizes) {
+    sizes.clear();
+    for (const std::string& item: Split(s, ',')) {
+        size_t size;
+        if (!ParseSize(item, size)) {
+            return false;
+        }
+        sizes.push_back(size);
+    }
+
+    return !sizes.empty();
+}
+
+// the names of the command line, `all` selects every engine
+inline bool SelectEngines(const std::string& names, std::vector<std::pair<std::string, EngineFactory>>& engines) {
+    for (const std::string& name: Split(names, ',')) {
+        bool known = false;
+        for (const auto& e: Engines()) {
+            if (name == "all" || name == e.first) {
+                engines.push_back(e);
+                known = true;
+            }
+        }
+
+        if (!known) {
+            return false;
+        }
+    }
+
+    return !engines.empty();
+}
+
+inline bool ReadFile(const std::string& path, std::string& content) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// the empty lines are skipped
+inline bool ReadLines(const std::string& path, std::vector<std::string>& lines) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+
+    return true;
+}
+
+// `alphabet` letters from 'a'
+inline std::string RandomText(size_t len, size_t alphabet, std::mt19937& rnd) {
+    std::uniform_int_distribution<int> letter(0, (int) std::max<size_t>(1, alphabet) - 1);
+    std::string text(len, 'a');
+    for (char& c: text) {
+        c = char('a' + letter(rnd));
+    }
+
+    return text;
+}
+
+inline std::vector<std::string> RandomDict(size_t count, size_t minLen, size_t maxLen, size_t alphabet, std::mt19937& rnd) {
+    std::uniform_int_distribution<size_t> len(minLen, std::max(minLen, maxLen));
+    std::vector<std::string> dict;
+    dict.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        dict.push_back(RandomText(len(rnd), alphabet, rnd));
+    }
+
+    return dict;
+}
+
+// substrings of the text, so every pattern is found
+inline std::vector<std::string> SampleDict(const std::string& text, size_t count, size_t minLen, size_t maxLen, std::mt19937& rnd) {
+    std::vector<std::string> dict;
+    if (text.size() < maxLen) {
+        return dict;
+    }
+
+    std::uniform_int_distribution<size_t> len(minLen, std::max(minLen, maxLen));
+    std::uniform_int_distribution<size_t> pos(0, text.size() - maxLen);
+    dict.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        dict.push_back(text.substr(pos(rnd), len(rnd)));
+    }
+
+    return dict;
+}
+
+// Minimal JSON writer, the commas are put by the nesting level:
+//     JsonWriter json(std::cout);
+//     json.BeginObject();
+//     json.Key("runs").Value(5);
+//     json.EndObject();
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream& out)
+        : _out(out)
+        , _first(1, true)
+        , _afterKey(false)
+    {
+        _out << std::setprecision(9);
+    }
+
+    JsonWriter& BeginObject() {
+        Separate();
+        _out << "{";
+        _first.push_back(true);
+        return *this;
+    }
+
+    JsonWriter& EndObject() {
+        _first.pop_back();
+        _out << "}";
+        return *this;
+    }
+
+    JsonWriter& BeginArray() {
+        Separate();
+        _out << "[";
+        _first.push_back(true);
+        return *this;
+    }
+
+    JsonWriter& EndArray() {
+        _first.pop_back();
+        _out << "]";
+        return *this;
+    }
+
+    JsonWriter& Key(const std::string& key) {
+        Separate();
+        String(key);
+        _out << ":";
+        _afterKey = true;
+        return *this;
+    }
+
+    JsonWriter& Value(const std::string& value) {
+        Separate();
+        String(value);
+        return *this;
+    }
+
+    JsonWriter& Value(const char * value) {
+        return Value(std::string(value));
+    }
+
+    JsonWriter& Value(bool value) {
+        Separate();
+        _out << (value ? "true" : "false");
+        return *this;
+    }
+
+    // nan and inf aren't valid JSON
+    JsonWriter& Value(double value) {
+        Separate();
+        if (std::isfinite(value)) {
+            _out << value;
+        } else {
+            _out << "null";
+        }
+        return *this;
+    }
+
+    template <typename IntT>
+    JsonWriter& Value(IntT value) {
+        Separate();
+        _out << value;
+        return *this;
+    }
+
+private:
+    void Separate() {
+        if (_afterKey) {
+            _afterKey = false;
+            return;
+        }
+
+        if (!_first.back()) {
+            _out << ",";
+        }
+        _first.back() = false;
+    }
+
+    void String(const std::string& s) {
+        _out << '"';
+        for (unsigned char c: s) {
+            if (c == '"' || c == '\\') {
+                _out << '\\' << c;
+            } else if (c < 0x20) {
+                _out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec << std::setfill(' ');
+            } else {
+                _out << c;
+            }
+        }
+        _out << '"';
+    }
+
+private:
+    std::ostream& _out;
+    std::vector<bool> _first;
+    bool _afterKey;
+};
+
+// `threads` threads scan the whole text at once, the time is from the start of the first one to the end of the last one
+inline double TimeScan(const PatternSearch<int>& ps, const std::string& text, size_t threads, size_t& found) {
+    if (threads <= 1) {
+        Stopwatch watch;
+        found = ps.Find(text).size();
+        return watch.Seconds();
+    }
+
+    std::vector<size_t> counts(threads);
+    std::vector<std::thread> pool;
+    Stopwatch watch;
+    for (size_t i = 0; i < threads; ++i) {
+        pool.emplace_back([&ps, &text, &counts, i] {
+            counts[i] = ps.Find(text).size();
+        });
+    }
+
+    for (std::thread& t: pool) {
+        t.join();
+    }
+
+    double seconds = watch.Seconds();
+    found = counts[0];
+    return seconds;
+}
+
+// seconds of a scan of the text, the short texts are scanned repeatedly for at least `minSeconds`
+inline double ScanTime(const PatternSearch<int>& ps, const std::string& text, double minSeconds, size_t& found) {
+    size_t scans = 0;
+    Stopwatch watch;
+    double seconds;
+    do {
+        found = ps.Find(text).size();
+        ++scans;
+    } while ((seconds = watch.Seconds()) < minSeconds);
+
+    return seconds / scans;
+}
+
+// [offset, offset + length) of the text
+typedef std::pair<size_t, size_t> Piece;
+
+// the consecutive buffers of `buffer` bytes, the tail is dropped
+inline std::vector<Piece> FixedPieces(size_t len, size_t buffer) {
+    std::vector<Piece> pieces;
+    for (size_t offset = 0; buffer && offset + buffer <= len; offset += buffer) {
+        pieces.emplace_back(offset, buffer);
+    }
+
+    return pieces;
+}
+
+// the packets are scanned as one text by the throughput runs and one by one by the latency ones
+inline void JoinPackets(const std::vector<std::string>& packets, std::string& text, std::vector<Piece>& pieces) {
+    for (const std::string& p: packets) {
+        pieces.emplace_back(text.size(), p.size());
+        text += p;
+    }
+}
+
+// nanoseconds of `Find` of every piece, they are taken round robin
+inline std::vector<double> Latencies(const PatternSearch<int>& ps, const std::string& text, const std::vector<Piece>& pieces,
+                                     size_t samples) {
+    std::vector<double> res;
+    if (pieces.empty()) {
+        return res;
+    }
+
+    res.reserve(samples);
+    for (size_t i = 0; i < samples; ++i) {
+        const Piece& piece = pieces[i % pieces.size()];
+
+        auto start = std::chrono::steady_clock::now();
+        ps.Find(text.data() + piece.first, piece.second);
+        res.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return res;
+}
+
+} // Bench
+} // StringAlgos
+
+#endif // HARNESS_H
@@ -0,0 +1,319 @@
+// StringAlgosSweep - the scaling of the engines by the size of the dictionary, the lengths of the patterns,
+// the alphabet and the size of the text. Every axis is swept with the other ones at their base values
+// (or all combinations with --grid), a CSV row is written for every engine at every point:
+//     StringAlgosSweep --engine aho,flat-aho,hyperscan --patterns 10,1K,100K,1M --texts 16M --out sweep.csv
+// With --workload dpi the patterns are the rules and the text is the packets of workload.h,
+// only the numbers of the patterns and the sizes of the text are swept then.
+// An engine is skipped at the next points of an axis when their time or memory extrapolated from the previous point
+// exceeds the limits, so the sweep goes on after the engine falls off a cliff.
+
+#include <iostream>
+#include <fstream>
+
+#include <harness.h>
+
+using namespace std;
+using namespace StringAlgos;
+using namespace StringAlgos::Bench;
+
+namespace {
+
+struct Options {
+    string engines = "trie,aho,aho-lazy,aho-sparse,aho-hybrid,flat-aho,hyperscan,hybrid";
+    string patterns = "10,100,1K,10K,100K,1M";
+    string lengths = "4-8,4-16,8-32,32-128";
+    string alphabets = "4,26,256";
+    string texts = "16K,1M,64M,1G";
+    string base = "1K,4-16,26,16M";
+    bool grid = false;
+    bool dpi = false;
+    double hitRatio = 0.1;
+    double minSeconds = 0.2;
+    double maxSeconds = 60;
+    size_t maxMemory = size_t(4) << 30;
+    unsigned seed = 1;
+    string out;
+};
+
+void Usage() {
+    cerr << "usage: StringAlgosSweep [options]" << endl
+         << "  --engine NAMES      comma separated names or `all`, see StringAlgosBench --list" << endl
+         << "  --patterns LIST     the numbers of the patterns, default 10,100,1K,10K,100K,1M" << endl
+         << "  --lengths LIST      the ranges of the lengths of the patterns, default 4-8,4-16,8-32,32-128" << endl
+         << "  --alphabets LIST    the sizes of the alphabet of the patterns and the text, default 4,26,256" << endl
+         << "  --texts LIST        the sizes of the text, default 16K,1M,64M,1G" << endl
+         << "  --base P,L,A,T      the values of the axes which aren't swept, default 1K,4-16,26,16M" << endl
+         << "  --grid              all combinations of the values instead of one axis at a time" << endl
+         << "  --workload NAME     random (default) or dpi, the traffic and the rules of workload.h" << endl
+         << "  --hit-ratio R       the part of the dpi rules drawn from the vocabulary of the traffic, default 0.1" << endl
+         << "  --min-seconds S     the short texts are scanned repeatedly for S seconds, default 0.2" << endl
+         << "  --max-seconds S     the limit of the build and the scan of one point, default 60" << endl
+         << "  --max-memory SIZE   the limit of MemoryUsage of one point, default 4G" << endl
+         << "  --seed N            of the random patterns and texts, default 1" << endl
+         << "  --out FILE          the CSV output, stdout by default" << endl;
+}
+
+bool ParseArgs(int argc, char ** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--grid") {
+            o.grid = true;
+            continue;
+        }
+
+        if (arg == "--help" || arg == "-h" || i + 1 == argc) {
+            return false;
+        }
+
+        string value = argv[++i];
+        bool ok = true;
+        if (arg == "--engine") {
+            o.engines = value;
+        } else if (arg == "--patterns") {
+            o.patterns = value;
+        } else if (arg == "--lengths") {
+            o.lengths = value;
+        } else if (arg == "--alphabets") {
+            o.alphabets = value;
+        } else if (arg == "--texts") {
+            o.texts = value;
+        } else if (arg == "--base") {
+            o.base = value;
+        } else if (arg == "--workload") {
+            o.dpi = value == "dpi";
+            ok = o.dpi || value == "random";
+        } else if (arg == "--hit-ratio") {
+            o.hitRatio = atof(value.c_str());
+            ok = o.hitRatio >= 0 && o.hitRatio <= 1;
+        } else if (arg == "--min-seconds") {
+            o.minSeconds = atof(value.c_str());
+        } else if (arg == "--max-seconds") {
+            o.maxSeconds = atof(value.c_str());
+            ok = o.maxSeconds > 0;
+        } else if (arg == "--max-memory") {
+            ok = ParseSize(value, o.maxMemory);
+        } else if (arg == "--seed") {
+            size_t seed;
+            ok = ParseSize(value, seed);
+            o.seed = (unsigned) seed;
+        } else if (arg == "--out") {
+            o.out = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            cerr << "bad option " << arg << " " << value << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct Point {
+    size_t patterns;
+    size_t minLen;
+    size_t maxLen;
+    size_t alphabet;
+    size_t text;
+};
+
+struct Axes {
+    vector<size_t> patterns;
+    vector<pair<size_t, size_t>> lengths;
+    vector<size_t> alphabets;
+    vector<size_t> texts;
+    Point base;
+};
+
+bool ParseLengths(const string& s, vector<pair<size_t, size_t>>& lengths) {
+    for (const string& item: Split(s, ',')) {
+        size_t min, max;
+        if (!ParseRange(item, min, max)) {
+            return false;
+        }
+        lengths.emplace_back(min, max);
+    }
+
+    return !lengths.empty();
+}
+
+// the lengths and the alphabet of the dpi workload are fixed, they are zeros in the rows
+bool ParseAxes(const Options& o, Axes& axes) {
+    vector<string> base = Split(o.base, ',');
+    vector<pair<size_t, size_t>> baseLen;
+    if (base.size() != 4 || !ParseSize(base[0], axes.base.patterns) || !ParseLengths(base[1], baseLen)
+            || !ParseSize(base[2], axes.base.alphabet) || !ParseSize(base[3], axes.base.text)) {
+        return false;
+    }
+    axes.base.minLen = baseLen[0].first;
+    axes.base.maxLen = baseLen[0].second;
+
+    if (!ParseSizes(o.patterns, axes.patterns) || !ParseLengths(o.lengths, axes.lengths)
+            || !ParseSizes(o.alphabets, axes.alphabets) || !ParseSizes(o.texts, axes.texts)) {
+        return false;
+    }
+
+    if (o.dpi) {
+        axes.base.minLen = axes.base.maxLen = axes.base.alphabet = 0;
+        axes.lengths.assign(1, make_pair(size_t(0), size_t(0)));
+        axes.alphabets.assign(1, 0);
+    }
+
+    return true;
+}
+
+// the points of the sweep with the name of the swept axis
+vector<pair<string, Point>> MakePoints(const Axes& axes, bool grid, bool dpi) {
+    vector<pair<string, Point>> points;
+    if (grid) {
+        for (size_t a: axes.alphabets) {
+            for (const auto& l: axes.lengths) {
+                for (size_t t: axes.texts) {
+                    for (size_t p: axes.patterns) {
+                        points.emplace_back("grid", Point{p, l.first, l.second, a, t});
+                    }
+                }
+            }
+        }
+
+        return points;
+    }
+
+    for (size_t p: axes.patterns) {
+        Point point = axes.base;
+        point.patterns = p;
+        points.emplace_back("patterns", point);
+    }
+
+    for (size_t i = 0; i < axes.lengths.size() && !dpi; ++i) {
+        Point point = axes.base;
+        point.minLen = axes.lengths[i].first;
+        point.maxLen = axes.lengths[i].second;
+        points.emplace_back("lengths", point);
+    }
+
+    for (size_t i = 0; i < axes.alphabets.size() && !dpi; ++i) {
+        Point point = axes.base;
+        point.alphabet = axes.alphabets[i];
+        points.emplace_back("alphabet", point);
+    }
+
+    for (size_t t: axes.texts) {
+        Point point = axes.base;
+        point.text = t;
+        points.emplace_back("text", point);
+    }
+
+    return points;
+}
+
+// the cost of the previous point of an engine, it's predicted for the skipped points
+struct Cost {
+    Point point;
+    double seconds;
+    double memory;
+};
+
+// The extrapolation is linear in the number of the patterns for the memory,
+// in the number of the patterns or the size of the text for the time. The prediction shrinks
+// with the sizes, so the smaller points of the grid are measured again.
+Cost Predict(const Cost& prev, const Point& next) {
+    double patterns = double(next.patterns) / std::max<size_t>(1, prev.point.patterns);
+    double text = double(next.text) / std::max<size_t>(1, prev.point.text);
+    return Cost{next, prev.seconds * std::max(patterns, text), prev.memory * patterns};
+}
+
+const char * kColumns = "workload,axis,engine,patterns,min_len,max_len,alphabet,text_bytes,inserted,build_seconds,"
+                        "memory_bytes,scan_seconds,mb_per_s,found,status";
+
+void WriteRow(ostream& out, const char * workload, const string& axis, const string& engine, const Point& p,
+              size_t inserted, double build, size_t memory, double scan, size_t found, const char * status) {
+    out << workload << "," << axis << "," << engine << "," << p.patterns << "," << p.minLen << "," << p.maxLen << ","
+        << p.alphabet << "," << p.text << "," << inserted << "," << build << "," << memory << ","
+        << scan << "," << (scan > 0 ? p.text / 1e6 / scan : 0) << "," << found << "," << status << endl;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    Options o;
+    Axes axes;
+    if (!ParseArgs(argc, argv, o) || !ParseAxes(o, axes)) {
+        Usage();
+        return 1;
+    }
+
+    vector<pair<string, EngineFactory>> engines;
+    if (!SelectEngines(o.engines, engines)) {
+        cerr << "unknown engine in " << o.engines << ", see StringAlgosBench --list" << endl;
+        return 1;
+    }
+
+    ofstream file;
+    if (!o.out.empty()) {
+        file.open(o.out);
+        if (!file) {
+            cerr << "can't open " << o.out << endl;
+            return 1;
+        }
+    }
+
+    ostream& out = o.out.empty() ? cout : file;
+    out << setprecision(6) << kColumns << endl;
+
+    // by the axis and the engine
+    map<pair<string, string>, Cost> costs;
+    const char * workload = o.dpi ? "dpi" : "random";
+    for (const auto& ap: MakePoints(axes, o.grid, o.dpi)) {
+        const string& axis = ap.first;
+        const Point& p = ap.second;
+
+        vector<string> dict;
+        string text;
+        if (o.dpi) {
+            DpiGenerator dpi(o.seed);
+            vector<Piece> packets;
+            JoinPackets(dpi.Packets(p.text, 64, 1500), text, packets);
+            dict = dpi.Rules(p.patterns, o.hitRatio);
+        } else {
+            mt19937 rnd(o.seed);
+            dict = RandomDict(p.patterns, p.minLen, p.maxLen, p.alphabet, rnd);
+            text = RandomText(p.text, p.alphabet, rnd);
+        }
+
+        for (const auto& e: engines) {
+            auto prev = costs.find(make_pair(axis, e.first));
+            if (prev != costs.end()) {
+                Cost next = Predict(prev->second, p);
+                if (next.seconds > o.maxSeconds || next.memory > o.maxMemory) {
+                    prev->second = next;
+                    WriteRow(out, workload, axis, e.first, p, 0, 0, 0, 0, 0, "skipped");
+                    continue;
+                }
+            }
+
+            cerr << axis << " " << e.first << " " << p.patterns << " " << p.minLen << "-" << p.maxLen
+                 << " " << p.alphabet << " " << p.text << endl;
+
+            EnginePtr ps = e.second();
+            Stopwatch buildWatch;
+            size_t inserted = 0;
+            for (size_t i = 0; i < dict.size(); ++i) {
+                inserted += ps->Insert(dict[i], (int) i);
+            }
+            ps->Build();
+            double build = buildWatch.Seconds();
+            size_t memory = ps->MemoryUsage().Total();
+
+            size_t found = 0;
+            double scan = ScanTime(*ps, text, o.minSeconds, found);
+
+            WriteRow(out, workload, axis, e.first, p, inserted, build, memory, scan, found, "ok");
+            costs[make_pair(axis, e.first)] = Cost{p, build + scan, double(memory)};
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,315 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+// Synthetic DPI workload of the benchmarks, it's generated offline from a seed:
+// packet payloads which look like HTTP requests and responses, DNS queries, TLS ClientHello records
+// and opaque binary streams, and the rule sets of URL fragments, user agents, hostnames and binary signatures.
+// `hitRatio` of the rules are drawn from the vocabulary of the traffic and the other ones from a separate vocabulary
+// which it doesn't use. A drawn rule isn't placed into the traffic on purpose, so fewer of them are found:
+// e.g. a signature occurs only in a quarter of the binary packets and a path may be never picked in a small traffic.
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace StringAlgos {
+namespace Bench {
+
+class DpiGenerator {
+public:
+    // `vocabulary` is the number of the hostnames, the paths and the signatures of the traffic
+    explicit DpiGenerator(unsigned seed, size_t vocabulary = 1000)
+        : _rnd(seed)
+    {
+        MakeVocabulary(_seen, vocabulary, false);
+        MakeVocabulary(_unseen, vocabulary, true);
+    }
+
+    // payloads of [minPacket, maxPacket] bytes, `bytes` in total
+    std::vector<std::string> Packets(size_t bytes, size_t minPacket, size_t maxPacket) {
+        std::uniform_int_distribution<size_t> size(std::max<size_t>(1, minPacket), std::max(minPacket, maxPacket));
+        std::vector<std::string> packets;
+
+        for (size_t total = 0; total < bytes; total += packets.back().size()) {
+            packets.push_back(Packet(std::min(size(_rnd), bytes - total)));
+        }
+
+        return packets;
+    }
+
+    // one packet of `size` bytes, the headers are truncated like in the first segment of a stream
+    std::string Packet(size_t size) {
+        std::string p;
+        int kind = Uniform(100);
+        if (kind < 40) {
+            p = HttpRequest();
+        } else if (kind < 55) {
+            p = HttpResponse();
+        } else if (kind < 75) {
+            p = DnsQuery();
+        } else if (kind < 95) {
+            p = TlsClientHello();
+        }
+
+        if (p.size() > size) {
+            p.resize(size);
+        }
+
+        Fill(p, kind, size);
+        return p;
+    }
+
+    // the mix of URL fragments (30%), user agent tokens (20%), hostnames (30%) and binary signatures (20%),
+    // `hitRatio` of them are drawn from the vocabulary of the traffic and may occur in it
+    std::vector<std::string> Rules(size_t count, double hitRatio) {
+        std::bernoulli_distribution hit(std::min(1.0, std::max(0.0, hitRatio)));
+        std::vector<std::string> rules;
+        rules.reserve(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            const Vocabulary& v = hit(_rnd) ? _seen : _unseen;
+            int kind = Uniform(10);
+            if (kind < 3) {
+                rules.push_back(Pick(v.paths));
+            } else if (kind < 5) {
+                rules.push_back(Pick(v.agents));
+            } else if (kind < 8) {
+                rules.push_back(Pick(v.hosts));
+            } else {
+                rules.push_back(Pick(v.signatures));
+            }
+        }
+
+        return rules;
+    }
+
+private:
+    struct Vocabulary {
+        std::vector<std::string> hosts;
+        std::vector<std::string> paths;
+        std::vector<std::string> agents;     // the product tokens of the user agents, e.g. "Firefox/115.0"
+        std::vector<std::string> signatures; // 8-16 random bytes
+    };
+
+    // The words of the unseen vocabulary are made of the consonants which the traffic never puts before a vowel
+    // and their versions of the user agents are greater, so its rules miss.
+    void MakeVocabulary(Vocabulary& v, size_t size, bool unseen) {
+        const char * consonants = unseen ? "qx" : "bcdfghklmnprstvz";
+
+        static const char * tlds[] = {".com", ".net", ".org", ".ru", ".io", ".de", ".cn"};
+        static const char * dirs[] = {"api", "v1", "v2", "static", "img", "js", "css", "login", "user", "search",
+                                      "cdn", "assets", "admin", "upload", "download", "media", "wp-content"};
+        static const char * exts[] = {".php", ".js", ".css", ".png", ".jpg", ".html", ".json", ""};
+        static const char * products[] = {"Firefox", "Chrome", "Safari", "Edge", "OPR", "curl", "Wget", "okhttp",
+                                          "python-requests", "Go-http-client", "Dalvik", "YaBrowser"};
+
+        for (size_t i = 0; i < size; ++i) {
+            std::string host = Uniform(2) ? "www." : "";
+            host += Word(2 + Uniform(3), consonants) + (Uniform(3) ? "" : "-" + Word(2, consonants)) + Pick(tlds);
+            v.hosts.push_back(host);
+
+            std::string path;
+            for (int j = 1 + Uniform(3); j > 0; --j) {
+                path += "/" + std::string(Pick(dirs));
+            }
+            path += "/" + Word(2 + Uniform(2), consonants) + Pick(exts);
+            v.paths.push_back(path);
+
+            std::string signature(8 + Uniform(9), 0);
+            for (char& c: signature) {
+                c = char(Uniform(256));
+            }
+            v.signatures.push_back(signature);
+        }
+
+        for (size_t i = 0; i < std::max<size_t>(1, size / 10); ++i) {
+            v.agents.push_back(std::string(Pick(products)) + "/" + std::to_string(Uniform(130) + (unseen ? 200 : 0)) + "."
+                               + std::to_string(Uniform(10)) + "." + std::to_string(Uniform(5000)));
+        }
+    }
+
+    std::string HttpRequest() {
+        static const char * methods[] = {"GET", "GET", "GET", "POST", "HEAD"};
+
+        std::string r = std::string(Pick(methods)) + " " + Pick(_seen.paths);
+        if (Uniform(2)) {
+            r += "?id=" + std::to_string(Uniform(100000)) + "&q=" + Hex(6);
+        }
+
+        r += " HTTP/1.1\r\nHost: " + Pick(_seen.hosts) + "\r\n";
+        r += "User-Agent: Mozilla/5.0 (" + std::string(Uniform(2) ? "Windows NT 10.0; Win64; x64" : "X11; Linux x86_64")
+           + ") " + Pick(_seen.agents) + "\r\n";
+        r += "Accept: */*\r\nAccept-Encoding: gzip, deflate, br\r\nConnection: keep-alive\r\n";
+        if (Uniform(2)) {
+            r += "Cookie: session=" + Hex(16) + "; lang=en\r\n";
+        }
+        r += "Referer: https://" + Pick(_seen.hosts) + Pick(_seen.paths) + "\r\n\r\n";
+        return r;
+    }
+
+    std::string HttpResponse() {
+        static const char * types[] = {"text/html; charset=utf-8", "application/json", "image/png",
+                                       "application/javascript", "text/css"};
+
+        std::string r = Uniform(8) ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n";
+        r += "Server: nginx/1." + std::to_string(Uniform(26)) + "\r\n";
+        r += "Content-Type: " + std::string(Pick(types)) + "\r\n";
+        r += "Content-Length: " + std::to_string(Uniform(100000)) + "\r\n";
+        r += "Set-Cookie: uid=" + Hex(8) + "; Domain=" + Pick(_seen.hosts) + "\r\n\r\n";
+        r += "<!DOCTYPE html><html><head><script src=\"" + Pick(_seen.paths) + "\"></script></head><body>";
+        return r;
+    }
+
+    // the header with a random id and the recursion desired flag, a question of type A or AAAA, class IN
+    std::string DnsQuery() {
+        std::string r;
+        Append16(r, Uniform(65536));
+        Append16(r, 0x0100);
+        Append16(r, 1);
+        Append16(r, 0);
+        Append16(r, 0);
+        Append16(r, 0);
+
+        std::string host = Pick(_seen.hosts);
+        size_t begin = 0;
+        for (size_t dot = host.find('.'); ; dot = host.find('.', begin)) {
+            size_t end = dot == std::string::npos ? host.size() : dot;
+            r.push_back(char(end - begin));
+            r.append(host, begin, end - begin);
+            if (dot == std::string::npos) {
+                break;
+            }
+            begin = dot + 1;
+        }
+        r.push_back(0);
+
+        Append16(r, Uniform(2) ? 1 : 28);
+        Append16(r, 1);
+        return r;
+    }
+
+    // the record header, the handshake header, the random, the cipher suites, the SNI and the ALPN extensions
+    std::string TlsClientHello() {
+        std::string host = Pick(_seen.hosts);
+
+        std::string ext;
+        Append16(ext, 0x0000);
+        Append16(ext, host.size() + 5);
+        Append16(ext, host.size() + 3);
+        ext.push_back(0);
+        Append16(ext, host.size());
+        ext += host;
+
+        const std::string alpn = std::string("\x02h2\x08http/1.1", 12);
+        Append16(ext, 0x0010);
+        Append16(ext, alpn.size() + 2);
+        Append16(ext, alpn.size());
+        ext += alpn;
+
+        std::string hello;
+        Append16(hello, 0x0303);
+        hello += Bytes(32);
+        hello.push_back(32);
+        hello += Bytes(32);
+        Append16(hello, 8);
+        for (unsigned suite: {0x1301u, 0x1302u, 0x1303u, 0xc02fu}) {
+            Append16(hello, suite);
+        }
+        hello += std::string("\x01\x00", 2);
+        Append16(hello, ext.size());
+        hello += ext;
+
+        std::string r("\x16\x03\x01", 3);
+        Append16(r, hello.size() + 4);
+        r.push_back(0x01);
+        r.push_back(0);
+        Append16(r, hello.size());
+        return r + hello;
+    }
+
+    // the rest of the packet: the text of HTTP, the padding of DNS, the encrypted bytes of TLS
+    // and the binary stream with a signature in every fourth packet
+    void Fill(std::string& p, int kind, size_t size) {
+        if (kind < 55) {
+            static const char * words[] = {"the", "and", "div", "class", "span", "data", "value", "true", "null",
+                                           "function", "return", "var", "items", "price", "title", "content"};
+            while (p.size() < size) {
+                p += Uniform(8) ? std::string(Pick(words)) + " " : "<a href=\"" + Pick(_seen.paths) + "\">";
+            }
+        } else if (kind < 75) {
+            p.append(size - std::min(size, p.size()), 0);
+        } else {
+            p += Bytes(size - std::min(size, p.size()));
+            if (kind >= 95 && !Uniform(4)) {
+                const std::string& signature = Pick(_seen.signatures);
+                if (signature.size() <= size) {
+                    p.replace(Uniform(size - signature.size() + 1), signature.size(), signature);
+                }
+            }
+        }
+
+        p.resize(size);
+    }
+
+    size_t Uniform(size_t n) {
+        return std::uniform_int_distribution<size_t>(0, n - 1)(_rnd);
+    }
+
+    template <typename T, size_t N>
+    const T& Pick(const T (&items)[N]) {
+        return items[Uniform(N)];
+    }
+
+    template <typename T>
+    const T& Pick(const std::vector<T>& items) {
+        return items[Uniform(items.size())];
+    }
+
+    // pronounceable, the syllables are a consonant and a vowel
+    std::string Word(size_t syllables, const char * consonants) {
+        static const char * vowels = "aeiou";
+        std::string w;
+        for (size_t i = 0; i < syllables; ++i) {
+            w.push_back(consonants[Uniform(strlen(consonants))]);
+            w.push_back(vowels[Uniform(5)]);
+        }
+
+        return w;
+    }
+
+    std::string Hex(size_t len) {
+        std::string h;
+        for (size_t i = 0; i < len; ++i) {
+            h.push_back("0123456789abcdef"[Uniform(16)]);
+        }
+
+        return h;
+    }
+
+    std::string Bytes(size_t len) {
+        std::string b(len, 0);
+        for (char& c: b) {
+            c = char(Uniform(256));
+        }
+
+        return b;
+    }
+
+    static void Append16(std::string& s, size_t value) {
+        s.push_back(char((value >> 8) & 0xff));
+        s.push_back(char(value & 0xff));
+    }
+
+private:
+    std::mt19937 _rnd;
+    Vocabulary _seen;   // the traffic is made from it
+    Vocabulary _unseen; // only the rules which miss
+};
+
+} // Bench
+} // StringAlgos
+
+#endif // WORKLOAD_H
@@ -4,51 +4,195 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <set>
+#include <map>
+#include <tuple>
 #include <memory>
 #include <queue>
 #include <cstring>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
 
 #include "PatternSearch.h"
+#include "CaseFolding.h"
+#include "ScanStats.h"
+#include "HitProfile.h"
 
 namespace StringAlgos {
 
+// how `Aho` keeps the transitions of the automaton
+struct AhoLayout {
+    enum Mode {
+        kDense, // `Build` computes the transitions of every state by all characters
+        kLazy,  // `Build` computes only failure links, a transition is computed at the first use and cached
+        kSparse, // only the edges of the trie and failure links, `Find` follows the links like the nfa
+        kHybrid, // rows of the shallow states are packed into one block, the deep states are sparse
+    };
+
+    static AhoLayout Dense() {
+        return AhoLayout{kDense, 0, 0};
+    }
+
+    // rows of the cached transitions take at most `memoryBudget` bytes,
+    // transitions of the other states are computed by failure links on every use
+    static AhoLayout Lazy(size_t memoryBudget = 64 << 20) {
+        return AhoLayout{kLazy, memoryBudget, 0};
+    }
+
+    // the smallest automaton, only the root has the row of transitions
+    static AhoLayout Sparse() {
+        return AhoLayout{kSparse, 0, 0};
+    }
+
+    // The scan spends most of the time in the states near the root: the states up to `maxDepth`
+    // get the rows in breadth-first order while they take at most `memoryBudget` bytes, so the block stays in the cache.
+    // The other states follow failure links until a state with the row.
+    static AhoLayout Hybrid(size_t maxDepth = 3, size_t memoryBudget = 1 << 20) {
+        return AhoLayout{kHybrid, memoryBudget, maxDepth};
+    }
+
+    Mode mode;
+    size_t memoryBudget;
+    size_t maxDepth;
+};
+
+// Patterns with kCaseless are supported: the first of them switches the trie to the folded case
+// and `Build` makes the transitions by both cases of a letter the same, so `Find` doesn't fold the text.
+// Case sensitive patterns with letters become checked outputs of the folded trie: they are compared
+// with the text when their vertex is reached.
+// Patterns with kAnchoredStart are kept in the separate trie which is walked only from the beginning of the text,
+// kAnchoredEnd and kWordBoundary are checked when the pattern is found.
+// The first pattern with kUtf8 and kCaseless switches the trie to the utf-8 folding (see Utf8Folding):
+// ascii is still folded by the transitions, two-byte sequences of the text are folded in the scan loop.
+// Only the first `maxKeyLen` bytes of a pattern are kept in the trie, so the number of states is bounded
+// by `maxKeyLen` x distinct prefixes: a longer pattern is a checked output, its tail is compared with the text after the key.
+// Patterns of one or two bytes aren't kept in the automaton, they are found by lookup tables (see IsShort).
 template <typename DataT>
 class Aho : public PatternSearch<DataT>
 {
 private:
     struct TrieVertex;
 
+    // the folding of the trie, it's changed only to the wider one
+    enum FoldMode {
+        kNoFold,
+        kAsciiFold,
+        kUtf8Fold,
+    };
+
+    // output which is reported only if the matched text is the same as the pattern and is placed right
+    struct CheckedOutput {
+        DataT data;
+        PatternOptions options;
+        std::string pattern;
+        size_t tail;          // bytes of the pattern after its key in the trie
+        uint64_t fingerprint; // of the tail
+        uint32_t id;          // of the data, see DataIds
+    };
+
+    struct ShortPattern {
+        std::string pattern;
+        DataT data;
+        PatternOptions options;
+
+        bool operator<(const ShortPattern& other) const {
+            return std::tie(pattern, data, options.flags) < std::tie(other.pattern, other.data, other.options.flags);
+        }
+    };
+
     typedef TrieVertex * TrieVertexPtr;
 
+    // transitions are cached by concurrent `Find` calls in kLazy mode
+    typedef std::atomic<TrieVertexPtr> Transition;
+
     struct TrieVertex {
         static const int kAlphabetSize = 256;
 
         TrieVertex(TrieVertexPtr refToParent, uchar_t parentCharacter)
-            : refToParent(refToParent)
+            : go(nullptr)
+            , refToParent(refToParent)
+            , depth(refToParent ? refToParent->depth + 1 : 0)
             , link(nullptr)
             , goodLink(nullptr)
             , cntChilds(0)
             , parentCharacter(parentCharacter)
             , terminal(false)
             , existTerminal(false)
-        {
-            memset(next, 0, sizeof(next));
-            memset(go, 0, sizeof(go));
+            , borrowedRow(false)
+            , index(UINT32_MAX)
+        {}
+
+        // The vertex of kDense automaton is allocated together with its row which is placed right after it,
+        // so the scan finds the row without a dependent load of `go`.
+        static TrieVertexPtr New(TrieVertexPtr refToParent, uchar_t parentCharacter, bool withRow) {
+            if (!withRow) {
+                return new TrieVertex(refToParent, parentCharacter);
+            }
+
+            void * mem = ::operator new(sizeof(TrieVertex) + kAlphabetSize * sizeof(Transition));
+            TrieVertexPtr v = new (mem) TrieVertex(refToParent, parentCharacter);
+
+            Transition * row = v->InlineRow();
+            for (int i = 0; i < kAlphabetSize; ++i) {
+                new (row + i) Transition(nullptr);
+            }
+
+            v->go.store(row, std::memory_order_relaxed);
+            v->borrowedRow = true;
+            return v;
+        }
+
+        static void operator delete(void * p) {
+            ::operator delete(p);
+        }
+
+        Transition * InlineRow() {
+            return reinterpret_cast<Transition *>(this + 1);
         }
 
         ~TrieVertex() {
-            for (int i = 0; i < kAlphabetSize; ++i) {
-                if (next[i]) {
-                    delete next[i];
-                    next[i] = nullptr;
-                }
+            if (!borrowedRow) {
+                delete[] go.load();
+            }
+
+            for (TrieVertexPtr child: childs) {
+                delete child;
             }
         }
 
-        TrieVertexPtr  next[kAlphabetSize];
-        TrieVertexPtr  go[kAlphabetSize];
+        // the edges of the trie are sorted by the character, memchr is faster than the binary search on short rows
+        TrieVertexPtr Child(uchar_t c) const {
+            // memchr mustn't get the null data of an empty row
+            if (keys.empty()) {
+                return nullptr;
+            }
+
+            const uchar_t * key = (const uchar_t *) memchr(keys.data(), c, keys.size());
+            return key ? childs[key - keys.data()] : nullptr;
+        }
+
+        void AddChild(uchar_t c, TrieVertexPtr child) {
+            size_t i = std::lower_bound(keys.begin(), keys.end(), c) - keys.begin();
+            keys.insert(keys.begin() + i, c);
+            childs.insert(childs.begin() + i, child);
+        }
+
+        // the child is deleted with its subtree
+        void EraseChild(uchar_t c) {
+            size_t i = std::lower_bound(keys.begin(), keys.end(), c) - keys.begin();
+            delete childs[i];
+            keys.erase(keys.begin() + i);
+            childs.erase(childs.begin() + i);
+        }
+
+        std::vector<uchar_t> keys;
+        std::vector<TrieVertexPtr> childs;
+        std::atomic<Transition *> go; // row of transitions by all characters, it's allocated separately
         TrieVertexPtr refToParent;
+        size_t depth;
         TrieVertexPtr link;
         TrieVertexPtr goodLink;
 
@@ -56,9 +200,14 @@ private:
         uchar_t parentCharacter;
         bool terminal;
         bool existTerminal;
+        bool borrowedRow; // the row is inline or in the block of kHybrid automaton, it isn't deleted with the vertex
+        uint32_t index;   // in breadth-first order of the last `Build`, the profile counts the visits by it
 
-        std::vector<DataT> data;
-        std::vector<DataT> data_link;
+        std::vector<uint32_t> ids;      // of the data
+        std::vector<uint32_t> ids_link;
+
+        std::vector<CheckedOutput> checked;
+        std::vector<const CheckedOutput *> checked_link;
     };
 
 public:
@@ -66,12 +215,28 @@ public:
     using PatternSearch<DataT>::Delete;
     using PatternSearch<DataT>::Find;
 
-    Aho()
-        : _root(new TrieVertex(nullptr, 0))
+    // `defaults` are the options of the patterns inserted without options,
+    // `maxKeyLen` is the maximal depth of the trie
+    explicit Aho(const PatternOptions& defaults = PatternOptions(), const AhoLayout& layout = AhoLayout::Dense(),
+                 size_t maxKeyLen = SIZE_MAX)
+        : _root(TrieVertex::New(nullptr, 0, layout.mode == AhoLayout::kDense))
+        , _anchoredRoot(new TrieVertex(nullptr, 0))
+        , _builded(false)
+        , _fold(kNoFold)
+        , _defaults(defaults)
+        , _layout(layout)
+        , _maxRows(layout.mode == AhoLayout::kLazy ? layout.memoryBudget / kRowSize : SIZE_MAX)
+        , _rows(0)
+        , _states(0)
+        , _stateBytes(0)
+        , _blockRows(0)
+        , _blockUsed(0)
+        , _maxKeyLen(std::max<size_t>(1, maxKeyLen))
     {}
 
     ~Aho() {
         delete _root;
+        delete _anchoredRoot;
     }
 
     // bfs
@@ -79,31 +244,51 @@ public:
         std::queue<TrieVertexPtr> q;
         q.push(_root);
 
+        const bool dense = _layout.mode == AhoLayout::kDense;
+        const bool hybrid = _layout.mode == AhoLayout::kHybrid;
+        _rows = 0;
+        _states = 0;
+        _stateBytes = 0;
+
+        if (hybrid) {
+            NewBlock(_profile.Visits());
+        }
+
+        BuildShort();
+
         while (!q.empty()) {
             TrieVertexPtr v = q.front();
             q.pop();
-            v->data_link.clear();
+            v->ids_link.clear();
+            v->checked_link.clear();
 
-            for (int i = 0; i < TrieVertex::kAlphabetSize; ++i) {
-                if (v->next[i]){
-                    q.push(v->next[i]);
-                }
+            for (TrieVertexPtr child: v->childs) {
+                q.push(child);
             }
 
+            uint32_t prevIndex = v->index;
+            v->index = _states++;
+            _stateBytes += sizeof(TrieVertex) + v->keys.capacity() + v->childs.capacity() * sizeof(TrieVertexPtr);
+
             if (v == _root || v->refToParent == _root) {
                 v->link = _root;
             } else {
                 TrieVertexPtr pr = v->refToParent;
-                v->link = pr->link->go[v->parentCharacter];
+                v->link = dense ? Row(pr->link)[v->parentCharacter].load(std::memory_order_relaxed)
+                                : LinkOf(pr->link, v->parentCharacter);
                 v->existTerminal = v->link->terminal | v->link->existTerminal;
             }
 
-            TrieVertexPtr linkVer = v->link;
-            for (int i = 0; i < TrieVertex::kAlphabetSize; ++i) {
-                if (!v->next[i])
-                    v->go[i] = (v == _root) ? _root : linkVer->go[i];
-                else
-                    v->go[i] = v->next[i];
+            // the root always has the row, the other ones are cached by `Find` in kLazy mode, aren't used in kSparse mode
+            // and are taken from the block by the shallow states in kHybrid mode
+            if (dense || (v == _root && !hybrid)) {
+                FillRow(v);
+            } else {
+                ReleaseRow(v);
+
+                if (hybrid && TakeBlockRow(v, prevIndex)) {
+                    FillRow(v);
+                }
             }
 
             if (v->existTerminal) {
@@ -111,35 +296,104 @@ public:
                 assert(fLinkVer != _root);
                 v->goodLink = (fLinkVer->terminal) ? fLinkVer : fLinkVer->goodLink;
 
-                v->data_link.insert(v->data_link.end(), v->goodLink->data.begin(), v->goodLink->data.end());
-                v->data_link.insert(v->data_link.end(), v->goodLink->data_link.begin(), v->goodLink->data_link.end());
+                v->ids_link.insert(v->ids_link.end(), v->goodLink->ids.begin(), v->goodLink->ids.end());
+                v->ids_link.insert(v->ids_link.end(), v->goodLink->ids_link.begin(), v->goodLink->ids_link.end());
+
+                for (const CheckedOutput& out: v->goodLink->checked) {
+                    v->checked_link.push_back(&out);
+                }
+                v->checked_link.insert(v->checked_link.end(), v->goodLink->checked_link.begin(), v->goodLink->checked_link.end());
             } else {
                 v->goodLink = _root;
             }
         }
 
+        // the states are renumbered
+        _profile.ResetVisits();
+        _hotRows.clear();
         _builded = true;
     }
 
     size_t Size() const override {
-        return _root->cntChilds;
+        return _root->cntChilds + _anchoredRoot->cntChilds + _short.size();
+    }
+
+    // number of the allocated rows of transitions, each one takes `kRowSize` bytes
+    size_t Rows() const {
+        return _rows.load(std::memory_order_relaxed);
+    }
+
+    // number of the states of the automaton after `Build`, the anchored trie isn't counted
+    size_t States() const {
+        return _states;
+    }
+
+    // memory of the states, the edges of the trie and the rows of transitions, outputs aren't counted
+    size_t TransitionMemory() const {
+        return _stateBytes + Rows() * kRowSize;
+    }
+
+    static const size_t kRowSize = TrieVertex::kAlphabetSize * sizeof(Transition);
+
+    // the rows are counted after `Build`, the unused rows of the kHybrid block too
+    MemoryStats MemoryUsage() const override {
+        MemoryStats res;
+        Count(_root, res);
+        Count(_anchoredRoot, res);
+
+        res.transitions += (Rows() + _blockRows - _blockUsed) * kRowSize;
+        res.outputs += HeapBytes(_shortBytes) + HeapBytes(_shortPairs) + _ids.MemoryUsage();
+        res.patterns += _short.size() * (sizeof(ShortPattern) + kNodeOverhead);
+        return res;
     }
 
     bool Insert(const char * pattern, size_t len, const DataT& data) override {
-        const uchar_t * first = (const uchar_t *) pattern;
-        const uchar_t * last = first + len;
+        return Insert(pattern, len, data, _defaults);
+    }
 
-        TrieVertexPtr curVer = _root;
+    bool Delete(const char * pattern, size_t len, const DataT& data) override {
+        return Delete(pattern, len, data, _defaults);
+    }
+
+    bool Insert(const char * pattern, size_t len, const DataT& data, const PatternOptions& patternOptions) override {
+        PatternOptions options;
+        if (!Canonical(pattern, len, patternOptions, options)) {
+            return false;
+        }
+
+        if (IsShort(len, options)) {
+            if (!_short.insert(ShortPattern{ShortKey(pattern, len, options), data, options}).second) {
+                return false;
+            }
+
+            _ids.Acquire(data);
+            _builded = false;
+            return true;
+        }
+
+        if (FoldOf(options) > _fold) {
+            Refold(FoldOf(options));
+        }
+
+        const std::string key = Key(pattern, len);
+        const uchar_t * first = (const uchar_t *) key.data();
+        const uchar_t * last = first + std::min(key.size(), _maxKeyLen);
+        bool checked = IsChecked(pattern, len, options);
+
+        TrieVertexPtr root = RootOf(options);
+        TrieVertexPtr curVer = root;
 
         for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
             uchar_t c = *ptr;
 
             curVer->cntChilds++;
-            if (!(curVer->next[c])) {
-                curVer->next[c] = new TrieVertex(curVer, c);
+            TrieVertexPtr to = curVer->Child(c);
+            if (!to) {
+                to = TrieVertex::New(curVer, c, root == _root && _layout.mode == AhoLayout::kDense);
+                curVer->AddChild(c, to);
             }
 
-            curVer = curVer->next[c];
+            curVer = to;
         }
         curVer->cntChilds++;
 
@@ -147,144 +401,948 @@ public:
 
         // assert that pair <pattern, data> is unique in the dictionary
         {
-            for (DataT& d: curVer->data) {
-                if (d == data) {
-                    curVer = _root;
+            if (FindOutput(curVer, pattern, len, data, options, checked)) {
+                curVer = root;
 
-                    for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
-                        uchar_t c = *ptr;
+                for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
+                    uchar_t c = *ptr;
 
-                        assert (curVer);
-                        curVer->cntChilds--;
-                        curVer = curVer->next[c];
-                    }
+                    assert (curVer);
                     curVer->cntChilds--;
-
-                    return false;
+                    curVer = curVer->Child(c);
                 }
+                curVer->cntChilds--;
+
+                return false;
             }
         }
 
-        curVer->data.push_back(data);
+        uint32_t id = _ids.Acquire(data);
+        if (checked) {
+            size_t tail = len - (last - first);
+            curVer->checked.push_back(CheckedOutput{data, options, std::string(pattern, len), tail, Fingerprint(pattern + len - tail, tail), id});
+        } else {
+            curVer->ids.push_back(id);
+        }
         _builded = false;
 
         return true;
     }
 
-    bool Delete(const char * pattern, size_t len, const DataT& data) override {
-        const uchar_t * first = (const uchar_t *) pattern;
-        const uchar_t * last = first + len;
+    bool Delete(const char * pattern, size_t len, const DataT& data, const PatternOptions& patternOptions) override {
+        PatternOptions options;
+        if (!Canonical(pattern, len, patternOptions, options)) {
+            return false;
+        }
 
-        TrieVertexPtr curVer = _root;
+        if (IsShort(len, options)) {
+            if (!_short.erase(ShortPattern{ShortKey(pattern, len, options), data, options})) {
+                return false;
+            }
+
+            _ids.Release(data);
+            _builded = false;
+            return true;
+        }
+
+        const std::string key = Key(pattern, len);
+        const uchar_t * first = (const uchar_t *) key.data();
+        const uchar_t * last = first + std::min(key.size(), _maxKeyLen);
+        bool checked = IsChecked(pattern, len, options);
+
+        TrieVertexPtr root = RootOf(options);
+        TrieVertexPtr curVer = root;
 
         // assert that `pattern` was added earlier to the dict
         {
-            if (len == 0) {
+            if (len == 0 || FoldOf(options) > _fold) {
                 return false;
             }
 
             for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
                 uchar_t c = *ptr;
-                curVer = curVer->next[c];
+                curVer = curVer->Child(c);
 
                 if (!curVer) {
                     return false;
                 }
             }
 
-            bool found = false;
-            for (DataT& d: curVer->data) {
-                if (d == data) {
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) {
+            if (!FindOutput(curVer, pattern, len, data, options, checked)) {
                 return false;
             }
         }
 
-        curVer = _root;
-        for (uchar_ptr_t ptr = first; ptr + 1 != last; ++ptr) {
+        EraseOutput(curVer, pattern, len, data, options, checked);
+        _ids.Release(data);
+
+        // the subtree is deleted when the pattern is the last one in it
+        curVer = root;
+        for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
             uchar_t c = *ptr;
 
             curVer->cntChilds--;
-            if (curVer->next[c]->cntChilds == 1) {
-                delete curVer->next[c];
-                curVer->next[c] = nullptr;
+            TrieVertexPtr to = curVer->Child(c);
+            if (to->cntChilds == 1) {
+                curVer->EraseChild(c);
                 curVer = nullptr;
                 break;
             }
 
-            curVer = curVer->next[c];
+            curVer = to;
         }
 
         if (curVer) {
-            uchar_t c = *(last - 1);
+            curVer->cntChilds--;
+            curVer->terminal = !curVer->ids.empty() || !curVer->checked.empty();
+        }
 
-            assert(len == 1 || curVer->cntChilds > 1);
-            assert(curVer->next[c]->terminal && curVer->next[c]->data.size());
+        _builded = false;
+        return true;
+    }
 
-            curVer->cntChilds--;
+    std::set<DataT> Find(const char *text, size_t len) const override {
+        TextSegment segment{text, len};
+        return Find(&segment, 1);
+    }
 
-            if (curVer->next[c]->cntChilds == 1) {
-                delete curVer->next[c];
-                curVer->next[c] = nullptr;
-            } else {
-                curVer = curVer->next[c];
-                for (auto it = curVer->data.begin(); it != curVer->data.end(); ++it) {
-                    if (*it == data) {
-                        curVer->data.erase(it);
-                        break;
-                    }
+    // the current vertex is carried from one segment to another
+    std::set<DataT> Find(const TextSegment * segments, size_t count) const override {
+        assert(("you should call `Build` function after modification (`Insert`, `Delete`)", _builded));
+
+        FoundIds res(_ids.Bound());
+        ScanStats stats;
+        auto * sample = _profile.Next();
+        bool stopped = sample ? FindSampled(segments, count, res, stats, *sample)
+                              : FindIds(segments, count, res, stats, [](TrieVertexPtr) {});
+        if (stopped) {
+            SCAN_STAT(++stats.earlyExits);
+        }
+
+        SCAN_STAT(++stats.scans; AddScanStats(stats));
+        std::set<DataT> found = res.Data(_ids);
+        if (sample) {
+            _profile.Record(*sample, found);
+        }
+
+        return found;
+    }
+
+    // Sampled profile of the scans: every `rate`-th `Find` of a thread counts the found data and the visits of the states.
+    // The next `Build` of kHybrid automaton gives the rows of its block to the most visited states.
+    void StartProfile(size_t rate = 64) {
+        _profile.Start(rate);
+    }
+
+    void StopProfile() {
+        _profile.Stop();
+    }
+
+    std::map<DataT, PatternHits> PatternProfile() const {
+        return _profile.Hits();
+    }
+
+    // the visits of the states since the last `Build` by the index in breadth-first order, the root is 0
+    std::vector<uint64_t> StateProfile() const {
+        return _profile.Visits();
+    }
+
+    uint64_t ProfiledScans() const {
+        return _profile.Scans();
+    }
+
+    void ResetProfile() {
+        _profile.Reset();
+    }
+
+private:
+    // the sampled scan, the buffer is locked by the thread for the time of the scan
+    bool FindSampled(const TextSegment * segments, size_t count, FoundIds& res, ScanStats& stats,
+                     typename HitProfile<DataT>::Sample& sample) const {
+        std::lock_guard<std::mutex> lock(sample.m);
+        std::vector<uint64_t>& visits = sample.visits;
+        visits.resize(_states);
+
+        return FindIds(segments, count, res, stats, [&visits](TrieVertexPtr v) {
+            ++visits[v->index];
+        });
+    }
+
+    // the scan records the ids of the found data, returns true if it's stopped since all of them are found;
+    // `visit(v)` is called for every state the automaton goes to
+    template <typename VisitT>
+    bool FindIds(const TextSegment * segments, size_t count, FoundIds& res, ScanStats& stats, VisitT visit) const {
+        TextView text(segments, count);
+
+        if (_anchoredRoot->cntChilds && FindAnchored(segments, count, text, res)) {
+            return true;
+        }
+
+        if ((!_shortBytes.empty() || !_shortPairs.empty()) && FindShort(segments, count, res)) {
+            return true;
+        }
+
+        if (!_root->cntChilds) {
+            return false;
+        }
+
+        switch (_layout.mode) {
+        case AhoLayout::kDense:
+            return Scan(segments, count, text, res, stats, [&visit](TrieVertexPtr v, uchar_t c) {
+                TrieVertexPtr to = v->InlineRow()[c].load(std::memory_order_relaxed);
+                visit(to);
+                return to;
+            });
+        case AhoLayout::kLazy:
+            return Scan(segments, count, text, res, stats, [this, &visit](TrieVertexPtr v, uchar_t c) {
+                TrieVertexPtr to = LazyNext(v, c);
+                visit(to);
+                return to;
+            });
+        case AhoLayout::kSparse:
+            return Scan(segments, count, text, res, stats, [this, &visit](TrieVertexPtr v, uchar_t c) {
+                TrieVertexPtr to = SparseNext(v, c);
+                visit(to);
+                return to;
+            });
+        case AhoLayout::kHybrid:
+            return Scan(segments, count, text, res, stats, [this, &visit](TrieVertexPtr v, uchar_t c) {
+                TrieVertexPtr to = HybridNext(v, c);
+                visit(to);
+                return to;
+            });
+        }
+
+        return false;
+    }
+
+    // `next(v, c)` is the transition of the automaton, returns true if all data are found
+    template <typename NextT>
+    bool Scan(const TextSegment * segments, size_t count, const TextView& text, FoundIds& res, ScanStats& stats, NextT next) const {
+        (void) stats; // it's counted only with SCAN_STATS
+        TrieVertexPtr curVer = _root;
+
+        if (_fold == kUtf8Fold) {
+            bool all = false;
+            ScanFolded(segments, count, false, [&](uchar_t c, size_t end) {
+                SCAN_STAT(TrieVertexPtr prev = curVer);
+                curVer = next(curVer, c);
+                SCAN_STAT(CountStep(prev, curVer, stats));
+                return all = Report(curVer, text, end, res);
+            });
+
+            return all;
+        }
+
+        size_t offset = 0;
+
+        for (size_t i = 0; i < count; offset += segments[i].len, ++i) {
+            const uchar_t * first = (const uchar_t *) segments[i].data;
+            const uchar_t * last = first + segments[i].len;
+
+            for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
+                uchar_t c = *ptr;
+
+                SCAN_STAT(TrieVertexPtr prev = curVer);
+                curVer = next(curVer, c);
+                assert(curVer);
+                SCAN_STAT(CountStep(prev, curVer, stats));
+
+                if (Report(curVer, text, offset + (ptr - first) + 1, res)) {
+                    return true;
                 }
+            }
+        }
+
+        return false;
+    }
+
+    // the counters of the transition `from` -> `to` by a byte of the text
+    void CountStep(TrieVertexPtr from, TrieVertexPtr to, ScanStats& stats) const {
+        ++stats.bytes;
+        stats.rootBytes += to == _root;
+        stats.linkSteps += to->depth <= from->depth;
+        stats.outputLinks += !to->ids_link.empty() || !to->checked_link.empty();
+        stats.matches += to->ids.size() + to->ids_link.size();
+    }
+
+    static Transition * NewRow() {
+        Transition * row = new Transition[TrieVertex::kAlphabetSize];
+        for (int i = 0; i < TrieVertex::kAlphabetSize; ++i) {
+            row[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        return row;
+    }
+
+    static Transition * Row(TrieVertexPtr v) {
+        return v->go.load(std::memory_order_relaxed);
+    }
+
+    // all transitions of the vertex, the row of its failure link is filled already
+    void FillRow(TrieVertexPtr v) {
+        Transition * row = Row(v);
+        if (!row) {
+            row = NewRow();
+            v->go.store(row, std::memory_order_relaxed);
+        }
+        ++_rows;
+
+        // the failure link of a hot state may have no row in kHybrid mode
+        Transition * linkRow = Row(v->link);
+        for (int i = 0; i < TrieVertex::kAlphabetSize; ++i) {
+            TrieVertexPtr to = (v == _root) ? _root
+                             : linkRow ? linkRow[i].load(std::memory_order_relaxed) : HybridNext(v->link, i);
+            row[i].store(to, std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < v->keys.size(); ++i) {
+            row[v->keys[i]].store(v->childs[i], std::memory_order_relaxed);
+        }
+
+        // the folded trie has only lower case edges
+        if (_fold != kNoFold) {
+            for (int i = 'A'; i <= 'Z'; ++i) {
+                row[i].store(row[AsciiFold(i)].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // the failure link of the child by `c` of the vertex with the failure link `u`
+    TrieVertexPtr LinkOf(TrieVertexPtr u, uchar_t c) const {
+        TrieVertexPtr to;
+        while (!(to = u->Child(c)) && u != _root) {
+            u = u->link;
+        }
+
+        return to ? to : _root;
+    }
+
+    uchar_t KeyByte(uchar_t c) const {
+        return _fold != kNoFold ? AsciiFold(c) : c;
+    }
+
+    // The transition in kLazy mode: it's taken from the row of the vertex or it's computed by the failure links.
+    // A row is allocated at the first visit of the vertex while the memory budget allows,
+    // concurrent calls write the same value, so relaxed stores are enough.
+    TrieVertexPtr LazyNext(TrieVertexPtr v, uchar_t c) const {
+        Transition * row = v->go.load(std::memory_order_acquire);
+
+        if (row) {
+            TrieVertexPtr to = row[c].load(std::memory_order_relaxed);
+            if (to) {
+                return to;
+            }
+        } else {
+            row = NewLazyRow(v);
+        }
+
+        // the row of the root is complete, so `v` isn't the root here
+        TrieVertexPtr to = v->Child(KeyByte(c));
+        if (!to) {
+            to = LazyNext(v->link, c);
+        }
+
+        if (row) {
+            row[c].store(to, std::memory_order_relaxed);
+        }
+
+        return to;
+    }
+
+    // The transition in kSparse mode: failure links are followed until there is an edge by `c`.
+    // The depth of the state is decreased by every link, so it's amortized O(1) per byte of the text.
+    TrieVertexPtr SparseNext(TrieVertexPtr v, uchar_t c) const {
+        const uchar_t key = KeyByte(c);
 
-                if (curVer->data.empty()) {
-                    curVer->terminal = false;
+        for (; v != _root; v = v->link) {
+            TrieVertexPtr to = v->Child(key);
+            if (to) {
+                return to;
+            }
+        }
+
+        return Row(_root)[c].load(std::memory_order_relaxed);
+    }
+
+    // The transition in kHybrid mode: failure links are followed until a state with the row or an edge by `c`,
+    // the links lead to the shallower states, so the root is reached at the latest.
+    TrieVertexPtr HybridNext(TrieVertexPtr v, uchar_t c) const {
+        const uchar_t key = KeyByte(c);
+
+        for (;; v = v->link) {
+            Transition * row = Row(v);
+            if (row) {
+                return row[c].load(std::memory_order_relaxed);
+            }
+
+            TrieVertexPtr to = v->Child(key);
+            if (to) {
+                return to;
+            }
+        }
+    }
+
+    // The block of rows for the shallow states or, after a profile, for the most visited ones:
+    // the rows of the hot states are adjacent in the order of their visits, the root is the first one.
+    // The states keep pointers to the old block until they are built.
+    void NewBlock(const std::vector<uint64_t>& visits) {
+        std::vector<uint32_t> hot;
+        CollectHot(_root, visits, hot);
+
+        size_t wanted = !hot.empty() ? hot.size() + 1 : CountShallow(_root);
+        _blockRows = std::max<size_t>(1, std::min(wanted, _layout.memoryBudget / kRowSize));
+        _blockUsed = 0;
+        _block.reset(new Transition[_blockRows * TrieVertex::kAlphabetSize]);
+        _hotRows.clear();
+
+        if (hot.empty()) {
+            return;
+        }
+
+        std::stable_sort(hot.begin(), hot.end(), [&visits](uint32_t a, uint32_t b) {
+            return visits[a] > visits[b];
+        });
+
+        _hotRows.assign(visits.size(), 0);
+        _hotRows[_root->index] = 1;
+        for (size_t i = 0; i + 1 < _blockRows; ++i) {
+            _hotRows[hot[i]] = i + 2;
+        }
+    }
+
+    // the indices of the visited states except the root, they are of the previous `Build`
+    void CollectHot(TrieVertexPtr v, const std::vector<uint64_t>& visits, std::vector<uint32_t>& hot) const {
+        for (TrieVertexPtr child: v->childs) {
+            if (child->index < visits.size() && visits[child->index]) {
+                hot.push_back(child->index);
+            }
+
+            CollectHot(child, visits, hot);
+        }
+    }
+
+    size_t CountShallow(TrieVertexPtr v) const {
+        size_t cnt = 1;
+        if (v->depth < _layout.maxDepth) {
+            for (TrieVertexPtr child: v->childs) {
+                cnt += CountShallow(child);
+            }
+        }
+
+        return cnt;
+    }
+
+    // the row of the hot state with the index `prevIndex` in the previous `Build` or the next row of the block,
+    // the shallow states are taken in breadth-first order
+    bool TakeBlockRow(TrieVertexPtr v, uint32_t prevIndex) {
+        const bool hot = !_hotRows.empty();
+        size_t slot = hot && prevIndex < _hotRows.size() ? _hotRows[prevIndex] : 0;
+
+        if (hot ? !slot : (v->depth > _layout.maxDepth || _blockUsed == _blockRows)) {
+            return false;
+        }
+
+        size_t row = hot ? slot - 1 : _blockUsed;
+        ++_blockUsed;
+        v->go.store(_block.get() + row * TrieVertex::kAlphabetSize, std::memory_order_relaxed);
+        v->borrowedRow = true;
+        return true;
+    }
+
+    static void ReleaseRow(TrieVertexPtr v) {
+        Transition * row = v->go.exchange(nullptr);
+        if (!v->borrowedRow) {
+            delete[] row;
+        }
+        v->borrowedRow = false;
+    }
+
+    // returns `nullptr` if the budget is exhausted
+    Transition * NewLazyRow(TrieVertexPtr v) const {
+        if (_rows.fetch_add(1, std::memory_order_relaxed) >= _maxRows) {
+            _rows.fetch_sub(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Transition * row = NewRow();
+        Transition * expected = nullptr;
+
+        // another thread has allocated the row
+        if (!v->go.compare_exchange_strong(expected, row, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            delete[] row;
+            _rows.fetch_sub(1, std::memory_order_relaxed);
+            return expected;
+        }
+
+        return row;
+    }
+
+    // the memory of the subtree besides the rows of transitions
+    static void Count(TrieVertexPtr v, MemoryStats& res) {
+        res.states += sizeof(TrieVertex);
+        res.transitions += HeapBytes(v->keys) + HeapBytes(v->childs);
+        res.outputs += HeapBytes(v->ids) + HeapBytes(v->ids_link) + HeapBytes(v->checked) + HeapBytes(v->checked_link);
+
+        for (const CheckedOutput& out: v->checked) {
+            res.patterns += HeapBytes(out.pattern);
+        }
+
+        for (TrieVertexPtr child: v->childs) {
+            Count(child, res);
+        }
+    }
+
+    // reports the outputs of the vertex reached by the text [0, end), returns true if all data are found
+    bool Report(TrieVertexPtr curVer, const TextView& text, size_t end, FoundIds& res) const {
+        // curVer has a data only when it's terminal vertex
+        res.Add(curVer->ids);
+
+        // ids_link are always good (terminal) data, pushed from another suffix verteces
+        res.Add(curVer->ids_link);
+
+        if (!curVer->checked.empty() || !curVer->checked_link.empty()) {
+            InsertChecked(curVer, text, end, res);
+        }
+
+        return res.Count() == _ids.Size();
+    }
+
+    // Calls `step(c, end)` for every byte of the text folded like the keys of the trie, `end` is the offset after the byte;
+    // ascii is folded only if `ascii` is set, since the transitions of the automaton fold it.
+    // A two-byte sequence is held until its second byte, fast path is a single comparison for ascii.
+    // The scan is stopped when `step` returns true.
+    template <typename StepT>
+    void ScanFolded(const TextSegment * segments, size_t count, bool ascii, StepT step) const {
+        const Utf8Folding& utf8 = Utf8Folding::Instance();
+        const bool foldAscii = ascii && _fold != kNoFold;
+        const bool unicode = _fold == kUtf8Fold;
+
+        uchar_t lead = 0;
+        size_t offset = 0;
+
+        for (size_t i = 0; i < count; offset += segments[i].len, ++i) {
+            const uchar_t * first = (const uchar_t *) segments[i].data;
+            const uchar_t * last = first + segments[i].len;
+
+            for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
+                uchar_t c = *ptr;
+                size_t end = offset + (ptr - first) + 1;
+
+                if (c < 0x80 && !lead) {
+                    if (step(foldAscii ? AsciiFold(c) : c, end)) return;
+                    continue;
                 }
 
-                curVer->cntChilds--;
+                if (lead) {
+                    uchar_t l = lead;
+                    lead = 0;
+
+                    if (Utf8Folding::IsContinuation(c)) {
+                        uint16_t f = utf8.Fold(l, c);
+                        if (step(0xC0 | (f >> 6), end - 1) || step(0x80 | (f & 0x3F), end)) return;
+                        continue;
+                    }
+
+                    if (step(l, end - 1)) return;
+                }
+
+                if (unicode && Utf8Folding::IsLead(c)) {
+                    lead = c;
+                } else if (step(foldAscii ? AsciiFold(c) : c, end)) {
+                    return;
+                }
             }
         }
 
-        _builded = false;
+        if (lead) {
+            step(lead, offset);
+        }
+    }
+
+    // kLiteral means nothing for the literal search, kCaseless - for a pattern without letters,
+    // kUtf8 - for a case sensitive pattern or a pattern without non-ascii letters,
+    // so such patterns are the same rule with and without them
+    static bool Canonical(const char * pattern, size_t len, const PatternOptions& options, PatternOptions& res) {
+        const unsigned supported = PatternOptions::kLiteral | PatternOptions::kCaseless | PatternOptions::kAnchoredStart |
+                                   PatternOptions::kAnchoredEnd | PatternOptions::kWordBoundary | PatternOptions::kUtf8;
+        if (options.flags & ~supported) {
+            return false;
+        }
+
+        if (options.Has(PatternOptions::kUtf8) && !IsValidUtf8(pattern, len)) {
+            return false;
+        }
+
+        res = options;
+        res.flags &= ~PatternOptions::kLiteral;
+
+        const Utf8Folding& utf8 = Utf8Folding::Instance();
+        if (!HasAsciiLetters(pattern, len) && !(res.Has(PatternOptions::kUtf8) && utf8.HasCased(pattern, len, true))) {
+            res.flags &= ~PatternOptions::kCaseless;
+        }
+
+        if (!res.Has(PatternOptions::kCaseless) || !utf8.HasCased(pattern, len, true)) {
+            res.flags &= ~PatternOptions::kUtf8;
+        }
+
         return true;
     }
 
-    std::set<DataT> Find(const char *text, size_t len) const override {
-        assert(("you should call `Build` function after modification (`Insert`, `Delete`)", _builded));
+    // the folding which is needed for the canonical options
+    static FoldMode FoldOf(const PatternOptions& options) {
+        if (!options.Has(PatternOptions::kCaseless)) {
+            return kNoFold;
+        }
+
+        return options.Has(PatternOptions::kUtf8) ? kUtf8Fold : kAsciiFold;
+    }
 
-        const uchar_t * first = (const uchar_t *) text;
-        const uchar_t * last = first + len;
+    std::string Key(const char * pattern, size_t len) const {
+        switch (_fold) {
+        case kAsciiFold:
+            return AsciiFold(pattern, len);
+        case kUtf8Fold:
+            return Utf8Folding::Instance().Fold(pattern, len);
+        default:
+            return std::string(pattern, len);
+        }
+    }
 
-        std::set<DataT> res;
-        TrieVertexPtr curVer = _root;
+    // The pattern is checked if the trie folds more characters than the pattern allows or it's longer than the key.
+    // Caseless patterns with non-ascii letters are checked in the ascii folded trie too, so they keep their bytes
+    // for the utf-8 refolding, where they are checked.
+    bool IsChecked(const char * pattern, size_t len, const PatternOptions& options) const {
+        if (options.Has(PatternOptions::kAnchoredEnd) || options.Has(PatternOptions::kWordBoundary) || len > _maxKeyLen) {
+            return true;
+        }
 
-        for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
-            uchar_t c = *ptr;
+        bool caseless = options.Has(PatternOptions::kCaseless);
 
-            curVer = curVer->go[c];
-            assert(curVer);
+        switch (_fold) {
+        case kAsciiFold:
+            return caseless ? Utf8Folding::Instance().HasCased(pattern, len, true) : HasAsciiLetters(pattern, len);
+        case kUtf8Fold:
+            return caseless ? !options.Has(PatternOptions::kUtf8) && Utf8Folding::Instance().HasCased(pattern, len, true)
+                            : Utf8Folding::Instance().HasCased(pattern, len, false);
+        default:
+            return false;
+        }
+    }
 
-            // curVer has a data only when it's terminal vertex
-            res.insert(curVer->data.begin(), curVer->data.end());
+    TrieVertexPtr RootOf(const PatternOptions& options) const {
+        return options.Has(PatternOptions::kAnchoredStart) ? _anchoredRoot : _root;
+    }
 
-            // data_link is always good (terminal) data, pushed from another suffix verteces
-            res.insert(curVer->data_link.begin(), curVer->data_link.end());
+    // a caseless pattern is the same rule in any case like in the folded trie
+    static bool SameOutput(const CheckedOutput& out, const char * pattern, size_t len, const DataT& data, const PatternOptions& options) {
+        if (out.data != data || !(out.options == options)) {
+            return false;
+        }
 
-            if (res.size() == Size()) {
-                break;
+        if (!options.Has(PatternOptions::kCaseless)) {
+            return out.pattern.size() == len && memcmp(out.pattern.data(), pattern, len) == 0;
+        }
+
+        const std::string& p = out.pattern;
+        return options.Has(PatternOptions::kUtf8) ? Utf8Folding::Instance().Fold(p.data(), p.size()) == Utf8Folding::Instance().Fold(pattern, len)
+                                                  : AsciiFold(p.data(), p.size()) == AsciiFold(pattern, len);
+    }
+
+    bool FindOutput(TrieVertexPtr v, const char * pattern, size_t len, const DataT& data, const PatternOptions& options, bool checked) const {
+        if (checked) {
+            for (const CheckedOutput& out: v->checked) {
+                if (SameOutput(out, pattern, len, data, options)) {
+                    return true;
+                }
             }
+
+            return false;
         }
 
-        return res;
+        uint32_t id = 0;
+        return _ids.Find(data, id) && std::find(v->ids.begin(), v->ids.end(), id) != v->ids.end();
+    }
+
+    void EraseOutput(TrieVertexPtr v, const char * pattern, size_t len, const DataT& data, const PatternOptions& options, bool checked) const {
+        if (checked) {
+            for (auto it = v->checked.begin(); it != v->checked.end(); ++it) {
+                if (SameOutput(*it, pattern, len, data, options)) {
+                    v->checked.erase(it);
+                    break;
+                }
+            }
+        } else {
+            // FindOutput has found the output
+            uint32_t id = 0;
+            bool found = _ids.Find(data, id);
+            assert(found);
+            (void) found;
+            v->ids.erase(std::find(v->ids.begin(), v->ids.end(), id));
+        }
+    }
+
+    // `end` is the offset right after the match of the key, the tail of the pattern follows it
+    static bool Check(const CheckedOutput& out, const TextView& text, size_t end) {
+        end += out.tail;
+        if (end > text.Size()) {
+            return false;
+        }
+
+        size_t begin = end - out.pattern.size();
+        bool caseless = out.options.Has(PatternOptions::kCaseless);
+
+        if (out.tail && !caseless && Fingerprint(text, end - out.tail, out.tail) != out.fingerprint) {
+            return false;
+        }
+
+        // the utf-8 folded key is matched by the trie
+        const std::string& p = out.pattern;
+        bool same = !caseless ? text.Equals(begin, p.data(), p.size())
+                  : !out.options.Has(PatternOptions::kUtf8) ? EqualsAsciiCaseless(text, begin, p.data(), p.size())
+                  : !out.tail || EqualsUtf8Caseless(text, begin, p.data(), p.size());
+
+        return same && IsPlaced(out.options, text, begin, end);
+    }
+
+    static void InsertChecked(TrieVertexPtr v, const TextView& text, size_t end, FoundIds& res) {
+        for (const CheckedOutput& out: v->checked) {
+            if (Check(out, text, end)) {
+                res.Add(out.id);
+            }
+        }
+
+        for (const CheckedOutput * out: v->checked_link) {
+            if (Check(*out, text, end)) {
+                res.Add(out->id);
+            }
+        }
+    }
+
+    // Patterns of one or two bytes without position options: their terminal states would be reached
+    // on almost every byte of the text, so they are found by the lookup of every byte and every pair of the text.
+    // kUtf8 caseless patterns aren't short, since a two-byte sequence may have more than two cases.
+    static bool IsShort(size_t len, const PatternOptions& options) {
+        const unsigned positions = PatternOptions::kAnchoredStart | PatternOptions::kAnchoredEnd | PatternOptions::kWordBoundary;
+        return len > 0 && len <= 2 && !(options.flags & positions) && !options.Has(PatternOptions::kUtf8);
+    }
+
+    // a caseless pattern is the same rule in any case like in the folded trie
+    static std::string ShortKey(const char * pattern, size_t len, const PatternOptions& options) {
+        return options.Has(PatternOptions::kCaseless) ? AsciiFold(pattern, len) : std::string(pattern, len);
+    }
+
+    // the characters of the text which are matched by `c`, returns their number
+    static size_t Cases(uchar_t c, bool caseless, uchar_t * res) {
+        res[0] = c;
+        if (!caseless || !IsAsciiLetter(c)) {
+            return 1;
+        }
+
+        res[0] = AsciiFold(c);
+        res[1] = res[0] - ('a' - 'A');
+        return 2;
+    }
+
+    // every case of a caseless pattern is a separate entry of the table
+    void BuildShort() {
+        _shortBytes.clear();
+        _shortPairs.clear();
+
+        for (const ShortPattern& p: _short) {
+            // the short patterns hold their data in `_ids`
+            uint32_t id = 0;
+            bool found = _ids.Find(p.data, id);
+            assert(found);
+            (void) found;
+
+            bool caseless = p.options.Has(PatternOptions::kCaseless);
+            uchar_t first[2], second[2];
+            size_t cntFirst = Cases(p.pattern[0], caseless, first);
+
+            if (p.pattern.size() == 1) {
+                for (size_t i = 0; i < cntFirst; ++i) {
+                    _shortBytes.push_back(std::make_pair(first[i], id));
+                }
+                continue;
+            }
+
+            size_t cntSecond = Cases(p.pattern[1], caseless, second);
+            for (size_t i = 0; i < cntFirst; ++i) {
+                for (size_t j = 0; j < cntSecond; ++j) {
+                    _shortPairs.push_back(std::make_pair(uint16_t(first[i] << 8 | second[j]), id));
+                }
+            }
+        }
+    }
+
+    // The bytes and the pairs of the text are marked in the tables of 256 entries and 64K bits without branches,
+    // then the tables are looked up by the short patterns. Returns true if all data are found.
+    // Neighbour bytes are marked in different tables, so the stores don't wait for each other.
+    bool FindShort(const TextSegment * segments, size_t count, FoundIds& res) const {
+        uchar_t bytes[4][TrieVertex::kAlphabetSize];
+        uint64_t pairs[(1 << 16) / 64];
+
+        const bool withBytes = !_shortBytes.empty();
+        const bool withPairs = !_shortPairs.empty();
+        memset(bytes, 0, sizeof(bytes));
+        if (withPairs) {
+            memset(pairs, 0, sizeof(pairs));
+        }
+
+        unsigned prev = 0;
+        bool hasPrev = false;
+
+        for (size_t i = 0; i < count; ++i) {
+            const uchar_t * p = (const uchar_t *) segments[i].data;
+            const size_t n = segments[i].len;
+            if (n == 0) {
+                continue;
+            }
+
+            if (withBytes) {
+                size_t j = 0;
+                for (; j + 4 <= n; j += 4) {
+                    bytes[0][p[j]] = 1;
+                    bytes[1][p[j + 1]] = 1;
+                    bytes[2][p[j + 2]] = 1;
+                    bytes[3][p[j + 3]] = 1;
+                }
+
+                for (; j < n; ++j) {
+                    bytes[0][p[j]] = 1;
+                }
+            }
+
+            if (withPairs) {
+                unsigned pair = prev << 8 | p[0];
+                if (hasPrev) {
+                    pairs[pair >> 6] |= uint64_t(1) << (pair & 63);
+                }
+
+                for (size_t j = 1; j < n; ++j) {
+                    pair = uint16_t(pair << 8 | p[j]);
+                    pairs[pair >> 6] |= uint64_t(1) << (pair & 63);
+                }
+            }
+
+            prev = p[n - 1];
+            hasPrev = true;
+        }
+
+        for (const auto& e: _shortBytes) {
+            if (bytes[0][e.first] | bytes[1][e.first] | bytes[2][e.first] | bytes[3][e.first]) {
+                res.Add(e.second);
+            }
+        }
+
+        for (const auto& e: _shortPairs) {
+            if (pairs[e.first >> 6] >> (e.first & 63) & 1) {
+                res.Add(e.second);
+            }
+        }
+
+        return res.Count() == _ids.Size();
     }
 
+    // the anchored trie is walked from the beginning of the text until there is no edge,
+    // returns true if all data are found
+    bool FindAnchored(const TextSegment * segments, size_t count, const TextView& text, FoundIds& res) const {
+        TrieVertexPtr curVer = _anchoredRoot;
+        bool all = false;
+
+        ScanFolded(segments, count, true, [&](uchar_t c, size_t end) {
+            curVer = curVer->Child(c);
+
+            if (!curVer) {
+                return true;
+            }
+
+            if (curVer->terminal) {
+                res.Add(curVer->ids);
+
+                for (const CheckedOutput& out: curVer->checked) {
+                    if (Check(out, text, end)) {
+                        res.Add(out.id);
+                    }
+                }
+
+                all = res.Count() == _ids.Size();
+            }
+
+            return all;
+        });
+
+        return all;
+    }
+
+    // all patterns are inserted again into the trie with the wider folding
+    void Refold(FoldMode fold) {
+        std::vector<CheckedOutput> patterns;
+        std::string path;
+        Collect(_root, PatternOptions(), path, patterns);
+        Collect(_anchoredRoot, PatternOptions(PatternOptions::kAnchoredStart), path, patterns);
+
+        delete _root;
+        delete _anchoredRoot;
+        _root = TrieVertex::New(nullptr, 0, _layout.mode == AhoLayout::kDense);
+        _anchoredRoot = new TrieVertex(nullptr, 0);
+        _fold = fold;
+
+        for (const CheckedOutput& p: patterns) {
+            _ids.Release(p.data);
+            Insert(p.pattern.data(), p.pattern.size(), p.data, p.options);
+        }
+    }
+
+    // The path to a vertex is the pattern of its data: the exact one in the trie without folding,
+    // the folded caseless one in the ascii folded trie, its pattern has no non-ascii letters, so it's the same rule.
+    // The utf-8 folded trie is never refolded.
+    void Collect(TrieVertexPtr v, const PatternOptions& options, std::string& path, std::vector<CheckedOutput>& patterns) const {
+        for (uint32_t id: v->ids) {
+            PatternOptions o = options;
+            if (_fold == kAsciiFold && HasAsciiLetters(path.data(), path.size())) {
+                o.flags |= PatternOptions::kCaseless;
+            }
+
+            // the unchecked pattern is the whole key, it has no tail
+            patterns.push_back(CheckedOutput{_ids.Data(id), o, path, 0, Fingerprint(path.data() + path.size(), 0), id});
+        }
+        patterns.insert(patterns.end(), v->checked.begin(), v->checked.end());
+
+        for (size_t i = 0; i < v->keys.size(); ++i) {
+            path.push_back(v->keys[i]);
+            Collect(v->childs[i], options, path, patterns);
+            path.pop_back();
+        }
+    }
 
 private:
     TrieVertexPtr _root;
+    TrieVertexPtr _anchoredRoot;
     bool _builded;
+    FoldMode _fold;
+    PatternOptions _defaults;
+
+    AhoLayout _layout;
+    size_t _maxRows;
+    mutable std::atomic<size_t> _rows;
+    size_t _states;
+    size_t _stateBytes;
+
+    std::unique_ptr<Transition[]> _block;
+    size_t _blockRows;
+    size_t _blockUsed;
+    std::vector<uint32_t> _hotRows; // 1 + the row of the block by the index of the state in the profile, empty without it
+
+    size_t _maxKeyLen;
+
+    std::set<ShortPattern> _short;
+    std::vector<std::pair<uchar_t, uint32_t>> _shortBytes; // ids of the data
+    std::vector<std::pair<uint16_t, uint32_t>> _shortPairs;
+
+    DataIds<DataT> _ids;
+    mutable HitProfile<DataT> _profile;
 };
 
 } // StringAlgos
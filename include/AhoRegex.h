@@ -0,0 +1,444 @@
+#ifndef AHOREGEX_H
+#define AHOREGEX_H
+
+#include <string>
+#include <vector>
+#include <regex>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include "PatternSearch.h"
+#include "Aho.h"
+
+namespace StringAlgos {
+
+// Regex search without Hyperscan: every regex is decomposed into the literal factors
+// which must be present in any match of it, factors of all regexs are searched by one Aho automaton,
+// and std::regex verifies only the regexs which have all their factors found in the text.
+// Regexs without factors (e.g. "a|b" or "\d+") are verified on every text.
+// std::regex is a recursive backtracking matcher, so it's intended for packet-sized texts.
+template <typename DataT>
+class AhoRegex : public PatternSearch<DataT>
+{
+    struct RuleKey {
+        std::string pattern;
+        DataT data;
+        PatternOptions options;
+
+        bool operator==(const RuleKey& other) const {
+            return data == other.data && options == other.options && pattern == other.pattern;
+        }
+    };
+
+    struct RuleKeyHash {
+        size_t operator()(const RuleKey& key) const {
+            size_t h = std::hash<std::string>()(key.pattern) ^ key.options.flags;
+            return h ^ (std::hash<DataT>()(key.data) + 0x9e3779b9 + (h << 6) + (h >> 2));
+        }
+    };
+
+    // factor is alive while at least one rule has it
+    struct Factor {
+        size_t id;
+        size_t refs;
+    };
+
+    // the factor and the flags it's searched with, caseless factors are folded
+    typedef std::pair<std::string, unsigned> FactorKey;
+
+    struct FactorKeyHash {
+        size_t operator()(const FactorKey& key) const {
+            return std::hash<std::string>()(key.first) ^ key.second;
+        }
+    };
+
+    typedef std::unordered_map<FactorKey, Factor, FactorKeyHash> Factors;
+    typedef typename Factors::value_type FactorEntry;
+
+    struct Rule {
+        std::vector<FactorEntry *> factors;
+        std::regex regex;
+        bool verify; // literals need no verification
+    };
+
+    typedef std::unordered_map<RuleKey, Rule, RuleKeyHash> Rules;
+    typedef typename Rules::value_type RuleEntry;
+
+public:
+    using PatternSearch<DataT>::Insert;
+    using PatternSearch<DataT>::Delete;
+    using PatternSearch<DataT>::Find;
+
+    // factor -> rules which have it, is rebuilt from the scratch
+    void Build() override {
+        _factorAho.Build();
+
+        _compiled.clear();
+        _unfiltered.clear();
+        _byFactor.assign(_nextFactorId, std::vector<size_t>());
+
+        for (const RuleEntry& e: _rules) {
+            if (e.second.factors.empty()) {
+                _unfiltered.push_back(&e);
+                continue;
+            }
+
+            for (const FactorEntry * f: e.second.factors) {
+                _byFactor[f->second.id].push_back(_compiled.size());
+            }
+            _compiled.push_back(&e);
+        }
+    }
+
+    size_t Size() const override {
+        return _rules.size();
+    }
+
+    // the automaton of the factors and the rules, compiled std::regex is counted only by its size
+    MemoryStats MemoryUsage() const override {
+        MemoryStats res = _factorAho.MemoryUsage();
+
+        for (const RuleEntry& e: _rules) {
+            res.patterns += sizeof(RuleEntry) + kNodeOverhead + HeapBytes(e.first.pattern) + HeapBytes(e.second.factors);
+        }
+
+        for (const FactorEntry& e: _factors) {
+            res.patterns += sizeof(FactorEntry) + kNodeOverhead + HeapBytes(e.first.first);
+        }
+
+        for (const std::vector<size_t>& rules: _byFactor) {
+            res.outputs += HeapBytes(rules);
+        }
+        res.outputs += HeapBytes(_byFactor) + HeapBytes(_compiled) + HeapBytes(_unfiltered);
+        return res;
+    }
+
+    bool Insert(const char * pattern, size_t len, const DataT& data) override {
+        return Insert(pattern, len, data, PatternOptions());
+    }
+
+    bool Delete(const char * pattern, size_t len, const DataT& data) override {
+        return Delete(pattern, len, data, PatternOptions());
+    }
+
+    // kMultiLine isn't supported by std::regex in c++11, kSomLeftmost doesn't matter since offsets aren't reported,
+    // position options of literal engines aren't supported like in Hyperscan
+    bool Insert(const char * pattern, size_t len, const DataT& data, const PatternOptions& options) override {
+        const unsigned unsupported = PatternOptions::kMultiLine | PatternOptions::kAnchoredStart |
+                                     PatternOptions::kAnchoredEnd | PatternOptions::kWordBoundary;
+        if (options.flags & unsupported) {
+            return false;
+        }
+
+        RuleKey key{std::string(pattern, len), data, options};
+        if (_rules.count(key)) {
+            return false;
+        }
+
+        Rule rule;
+        std::vector<std::string> factors;
+        unsigned factorFlags = 0;
+
+        if (options.Has(PatternOptions::kLiteral)) {
+            if (len == 0) {
+                return false;
+            }
+
+            rule.verify = false;
+            factorFlags = options.flags & (PatternOptions::kCaseless | PatternOptions::kUtf8);
+            factors.push_back(factorFlags & PatternOptions::kCaseless ? AsciiFold(pattern, len) : key.pattern);
+        } else {
+            rule.verify = true;
+
+            std::regex::flag_type flags = std::regex::ECMAScript | std::regex::nosubs;
+            if (options.Has(PatternOptions::kCaseless)) {
+                flags |= std::regex::icase;
+            }
+
+            try {
+                rule.regex = std::regex(ToECMAScript(key.pattern, options), flags);
+            } catch (const std::regex_error&) {
+                return false;
+            }
+
+            // the factors of regexs are searched case sensitive
+            if (options.Has(PatternOptions::kCaseless) || !RequiredFactors(pattern, len, factors)) {
+                factors.clear();
+            }
+        }
+
+        for (const std::string& f: factors) {
+            auto r = _factors.emplace(FactorKey(f, factorFlags), Factor{0, 0});
+            if (r.second) {
+                r.first->second.id = NewFactorId();
+                _factorAho.Insert(f, r.first->second.id, PatternOptions(factorFlags));
+            }
+
+            r.first->second.refs++;
+            rule.factors.push_back(&*r.first);
+        }
+
+        _rules.emplace(std::move(key), std::move(rule));
+        return true;
+    }
+
+    bool Delete(const char * pattern, size_t len, const DataT& data, const PatternOptions& options) override {
+        auto it = _rules.find(RuleKey{std::string(pattern, len), data, options});
+        if (it == _rules.end()) {
+            return false;
+        }
+
+        for (FactorEntry * f: it->second.factors) {
+            if (--f->second.refs == 0) {
+                _factorAho.Delete(f->first.first, f->second.id, PatternOptions(f->first.second));
+                _freeIds.push_back(f->second.id);
+                _factors.erase(_factors.find(f->first));
+            }
+        }
+
+        _rules.erase(it);
+        return true;
+    }
+
+    std::set<DataT> Find(const char * text, size_t len) const override {
+        std::set<DataT> res;
+
+        // number of found factors of every candidate rule
+        std::unordered_map<size_t, size_t> found;
+        for (size_t f: _factorAho.Find(text, len)) {
+            for (size_t rule: _byFactor[f]) {
+                ++found[rule];
+            }
+        }
+
+        for (const auto& pp: found) {
+            const RuleEntry * e = _compiled[pp.first];
+
+            if (pp.second == e->second.factors.size() && (!e->second.verify || Verify(e->second, text, len))) {
+                res.insert(e->first.data);
+            }
+        }
+
+        for (const RuleEntry * e: _unfiltered) {
+            if (Verify(e->second, text, len)) {
+                res.insert(e->first.data);
+            }
+        }
+
+        return res;
+    }
+
+    // Writes the literals which are present in every match of the regex to `factors`:
+    // runs of plain characters at the top level of the regex which aren't made optional by a quantifier.
+    // Returns false if the regex isn't understood or has an alternation at the top level.
+    static bool RequiredFactors(const char * pattern, size_t len, std::vector<std::string>& factors) {
+        factors.clear();
+        std::string run;
+
+        auto flush = [&]() {
+            if (!run.empty() && std::find(factors.begin(), factors.end(), run) == factors.end()) {
+                factors.push_back(run);
+            }
+            run.clear();
+        };
+
+        for (size_t i = 0; i < len; ) {
+            char c = pattern[i];
+            bool plain = false;
+            char literal = 0;
+            size_t next = i + 1;
+
+            if (c == '\\') {
+                if (i + 1 == len) {
+                    return false;
+                }
+
+                char e = pattern[i + 1];
+                next = i + 2;
+
+                if (ispunct((uchar_t) e)) {
+                    plain = true;
+                    literal = e;
+                } else if (!strchr("dDwWsSbBntrfv", e)) {
+                    // codes like \x41 or \cA
+                    return false;
+                }
+            } else if (c == '|' || c == ')') {
+                return false;
+            } else if (c == '(' || c == '[') {
+                next = SkipGroup(pattern, len, i);
+                if (next == 0) {
+                    return false;
+                }
+            } else if (!strchr(".^$?*+{}", c)) {
+                plain = true;
+                literal = c;
+            } else if (strchr("?*+{", c)) {
+                // quantifier without an atom
+                return false;
+            }
+
+            // quantifier of the atom
+            bool optional = false;
+            bool repeated = false;
+            if (next < len && strchr("?*+{", pattern[next])) {
+                char q = pattern[next];
+                optional = (q == '?' || q == '*' || (q == '{' && next + 1 < len && pattern[next + 1] == '0'));
+                repeated = true;
+
+                if (q == '{') {
+                    const char * close = (const char *) memchr(pattern + next, '}', len - next);
+                    if (!close) {
+                        return false;
+                    }
+                    next = close - pattern + 1;
+                } else {
+                    ++next;
+                }
+
+                // lazy or possessive modifier
+                if (next < len && (pattern[next] == '?' || pattern[next] == '+')) {
+                    ++next;
+                }
+            }
+
+            if (plain && !optional) {
+                run.push_back(literal);
+            }
+
+            if (!plain || repeated) {
+                flush();
+            }
+
+            i = next;
+        }
+
+        flush();
+        return true;
+    }
+
+private:
+    size_t NewFactorId() {
+        if (_freeIds.empty()) {
+            return _nextFactorId++;
+        }
+
+        size_t id = _freeIds.back();
+        _freeIds.pop_back();
+        return id;
+    }
+
+    // returns the position after the group or the class started at `i`, 0 if it isn't closed
+    static size_t SkipGroup(const char * pattern, size_t len, size_t i) {
+        int depth = 0;
+
+        for (; i < len; ++i) {
+            char c = pattern[i];
+
+            if (c == '\\') {
+                ++i;
+            } else if (c == '[') {
+                // ']' right after '[' or '[^' is a character of the class
+                size_t j = i + 1;
+                if (j < len && pattern[j] == '^') ++j;
+                if (j < len && pattern[j] == ']') ++j;
+
+                for (; j < len && pattern[j] != ']'; ++j) {
+                    if (pattern[j] == '\\') ++j;
+                }
+
+                if (j >= len) {
+                    return 0;
+                }
+
+                i = j;
+                if (depth == 0) {
+                    return i + 1;
+                }
+            } else if (c == '(') {
+                ++depth;
+            } else if (c == ')') {
+                if (--depth == 0) {
+                    return i + 1;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    // leading and trailing ".*" don't change the result of the search, but make backtracking slower;
+    // kDotAll is emulated by [\s\S] which matches any character
+    static std::string ToECMAScript(const std::string& pattern, const PatternOptions& options) {
+        std::string res;
+        res.reserve(pattern.size());
+
+        size_t first = 0;
+        size_t last = pattern.size();
+
+        // ".*?" and ".*+" are kept as is
+        while (last - first >= 2 && pattern.compare(first, 2, ".*") == 0 &&
+               (last - first == 2 || !strchr("?+{", pattern[first + 2]))) {
+            first += 2;
+        }
+
+        while (last - first >= 2 && pattern.compare(last - 2, 2, ".*") == 0 && !Escaped(pattern, last - 2, first)) {
+            last -= 2;
+        }
+
+        bool inClass = false;
+        for (size_t i = first; i < last; ++i) {
+            char c = pattern[i];
+
+            if (c == '\\' && i + 1 < last) {
+                res.push_back(c);
+                res.push_back(pattern[++i]);
+                continue;
+            }
+
+            if (c == '[') inClass = true;
+            if (c == ']') inClass = false;
+
+            if (c == '.' && !inClass && options.Has(PatternOptions::kDotAll)) {
+                res.append("[\\s\\S]");
+            } else {
+                res.push_back(c);
+            }
+        }
+
+        return res;
+    }
+
+    // is the character at `pos` escaped by an odd number of backslashes
+    static bool Escaped(const std::string& pattern, size_t pos, size_t first) {
+        size_t cnt = 0;
+        while (pos > first && pattern[pos - 1] == '\\') {
+            --pos;
+            ++cnt;
+        }
+
+        return cnt % 2;
+    }
+
+    static bool Verify(const Rule& rule, const char * text, size_t len) {
+        return std::regex_search(text, text + len, rule.regex);
+    }
+
+private:
+    Rules _rules;
+    Factors _factors;
+    size_t _nextFactorId = 0;
+    std::vector<size_t> _freeIds;
+    Aho<size_t> _factorAho;
+
+    std::vector<const RuleEntry *> _compiled;
+    std::vector<const RuleEntry *> _unfiltered;
+    std::vector<std::vector<size_t>> _byFactor;
+};
+
+} // StringAlgos
+
+#endif // AHOREGEX_H
@@ -0,0 +1,232 @@
+#ifndef CASEFOLDING_H
+#define CASEFOLDING_H
+
+#include <string>
+#include <cstdint>
+
+#include "PatternSearch.h"
+
+namespace StringAlgos {
+
+// ascii case folding, the folded form of a letter is its lower case
+
+inline bool IsAsciiLetter(uchar_t c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline uchar_t AsciiFold(uchar_t c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+inline bool HasAsciiLetters(const char * s, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (IsAsciiLetter(s[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline std::string AsciiFold(const char * s, size_t len) {
+    std::string res(s, len);
+    for (char& c: res) {
+        c = AsciiFold(c);
+    }
+
+    return res;
+}
+
+// case insensitive comparison of `s` with the text at `pos`
+inline bool EqualsAsciiCaseless(const TextView& text, size_t pos, const char * s, size_t len) {
+    if (pos + len > text.Size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (AsciiFold(text[pos + i]) != AsciiFold(s[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// well-formed utf-8: no overlong forms, surrogates and code points above U+10FFFF
+inline bool IsValidUtf8(const char * s, size_t len) {
+    const uchar_t * p = (const uchar_t *) s;
+
+    for (size_t i = 0; i < len; ) {
+        uchar_t c = p[i];
+        size_t n;
+        uchar_t lo = 0x80, hi = 0xBF; // range of the second byte
+
+        if (c < 0x80) {
+            ++i;
+            continue;
+        } else if (c >= 0xC2 && c <= 0xDF) {
+            n = 2;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 3;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 4;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return false;
+        }
+
+        if (i + n > len || p[i + 1] < lo || p[i + 1] > hi) {
+            return false;
+        }
+
+        for (size_t j = 2; j < n; ++j) {
+            if ((p[i + j] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+
+        i += n;
+    }
+
+    return true;
+}
+
+// Unicode simple case folding of the code points below U+0800, i.e. ascii and two-byte utf-8 sequences.
+// Only the foldings which keep the length of utf-8 are used, so the text can be folded byte by byte:
+// U+017F (to 's') and U+023A, U+023E (to three-byte sequences) aren't folded.
+// Code points from U+0800 aren't folded at all.
+class Utf8Folding {
+public:
+    static const size_t kSize = 0x800;
+
+    static const Utf8Folding& Instance() {
+        static const Utf8Folding folding;
+        return folding;
+    }
+
+    static bool IsLead(uchar_t c) {
+        return c >= 0xC2 && c <= 0xDF;
+    }
+
+    static bool IsContinuation(uchar_t c) {
+        return (c & 0xC0) == 0x80;
+    }
+
+    // the folded code point of the two-byte sequence
+    uint16_t Fold(uchar_t lead, uchar_t continuation) const {
+        return _fold[((lead & 0x1F) << 6) | (continuation & 0x3F)];
+    }
+
+    // the folding of the string is the same as the folding of the text in the scan
+    std::string Fold(const char * s, size_t len) const {
+        std::string res(s, len);
+
+        for (size_t i = 0; i < len; ++i) {
+            uchar_t c = s[i];
+
+            if (c < 0x80) {
+                res[i] = _fold[c];
+            } else if (IsLead(c) && i + 1 < len && IsContinuation(s[i + 1])) {
+                uint16_t f = Fold(c, s[i + 1]);
+                res[i] = 0xC0 | (f >> 6);
+                res[++i] = 0x80 | (f & 0x3F);
+            }
+        }
+
+        return res;
+    }
+
+    // is there a character which has the other case, only non-ascii ones are looked for if `nonAscii` is set
+    bool HasCased(const char * s, size_t len, bool nonAscii) const {
+        for (size_t i = 0; i < len; ++i) {
+            uchar_t c = s[i];
+
+            if (c < 0x80) {
+                if (!nonAscii && _cased[c]) {
+                    return true;
+                }
+            } else if (IsLead(c) && i + 1 < len && IsContinuation(s[i + 1])) {
+                if (_cased[((c & 0x1F) << 6) | (s[++i] & 0x3F)]) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+private:
+    // code points [first, last] with the step `stride` are folded to `cp + delta`
+    struct Range {
+        uint16_t first;
+        uint16_t last;
+        int16_t delta;
+        uint8_t stride;
+    };
+
+    Utf8Folding() {
+        static const Range ranges[] = {
+            {0x0041, 0x005A, 32, 1}, {0x00B5, 0x00B5, 775, 1}, {0x00C0, 0x00D6, 32, 1}, {0x00D8, 0x00DE, 32, 1},
+            {0x0100, 0x012E, 1, 2}, {0x0132, 0x0136, 1, 2}, {0x0139, 0x0147, 1, 2}, {0x014A, 0x0176, 1, 2},
+            {0x0178, 0x0178, -121, 1}, {0x0179, 0x017D, 1, 2}, {0x0181, 0x0181, 210, 1}, {0x0182, 0x0184, 1, 2},
+            {0x0186, 0x0186, 206, 1}, {0x0187, 0x0187, 1, 1}, {0x0189, 0x018A, 205, 1}, {0x018B, 0x018B, 1, 1},
+            {0x018E, 0x018E, 79, 1}, {0x018F, 0x018F, 202, 1}, {0x0190, 0x0190, 203, 1}, {0x0191, 0x0191, 1, 1},
+            {0x0193, 0x0193, 205, 1}, {0x0194, 0x0194, 207, 1}, {0x0196, 0x0196, 211, 1}, {0x0197, 0x0197, 209, 1},
+            {0x0198, 0x0198, 1, 1}, {0x019C, 0x019C, 211, 1}, {0x019D, 0x019D, 213, 1}, {0x019F, 0x019F, 214, 1},
+            {0x01A0, 0x01A4, 1, 2}, {0x01A6, 0x01A6, 218, 1}, {0x01A7, 0x01A7, 1, 1}, {0x01A9, 0x01A9, 218, 1},
+            {0x01AC, 0x01AC, 1, 1}, {0x01AE, 0x01AE, 218, 1}, {0x01AF, 0x01AF, 1, 1}, {0x01B1, 0x01B2, 217, 1},
+            {0x01B3, 0x01B5, 1, 2}, {0x01B7, 0x01B7, 219, 1}, {0x01B8, 0x01B8, 1, 1}, {0x01BC, 0x01BC, 1, 1},
+            {0x01C4, 0x01C4, 2, 1}, {0x01C5, 0x01C5, 1, 1}, {0x01C7, 0x01C7, 2, 1}, {0x01C8, 0x01C8, 1, 1},
+            {0x01CA, 0x01CA, 2, 1}, {0x01CB, 0x01DB, 1, 2}, {0x01DE, 0x01EE, 1, 2}, {0x01F1, 0x01F1, 2, 1},
+            {0x01F2, 0x01F4, 1, 2}, {0x01F6, 0x01F6, -97, 1}, {0x01F7, 0x01F7, -56, 1}, {0x01F8, 0x021E, 1, 2},
+            {0x0220, 0x0220, -130, 1}, {0x0222, 0x0232, 1, 2}, {0x023B, 0x023B, 1, 1}, {0x023D, 0x023D, -163, 1},
+            {0x0241, 0x0241, 1, 1}, {0x0243, 0x0243, -195, 1}, {0x0244, 0x0244, 69, 1}, {0x0245, 0x0245, 71, 1},
+            {0x0246, 0x024E, 1, 2}, {0x0345, 0x0345, 116, 1}, {0x0370, 0x0372, 1, 2}, {0x0376, 0x0376, 1, 1},
+            {0x037F, 0x037F, 116, 1}, {0x0386, 0x0386, 38, 1}, {0x0388, 0x038A, 37, 1}, {0x038C, 0x038C, 64, 1},
+            {0x038E, 0x038F, 63, 1}, {0x0391, 0x03A1, 32, 1}, {0x03A3, 0x03AB, 32, 1}, {0x03C2, 0x03C2, 1, 1},
+            {0x03CF, 0x03CF, 8, 1}, {0x03D0, 0x03D0, -30, 1}, {0x03D1, 0x03D1, -25, 1}, {0x03D5, 0x03D5, -15, 1},
+            {0x03D6, 0x03D6, -22, 1}, {0x03D8, 0x03EE, 1, 2}, {0x03F0, 0x03F0, -54, 1}, {0x03F1, 0x03F1, -48, 1},
+            {0x03F4, 0x03F4, -60, 1}, {0x03F5, 0x03F5, -64, 1}, {0x03F7, 0x03F7, 1, 1}, {0x03F9, 0x03F9, -7, 1},
+            {0x03FA, 0x03FA, 1, 1}, {0x03FD, 0x03FF, -130, 1}, {0x0400, 0x040F, 80, 1}, {0x0410, 0x042F, 32, 1},
+            {0x0460, 0x0480, 1, 2}, {0x048A, 0x04BE, 1, 2}, {0x04C0, 0x04C0, 15, 1}, {0x04C1, 0x04CD, 1, 2},
+            {0x04D0, 0x052E, 1, 2}, {0x0531, 0x0556, 48, 1}
+        };
+
+        for (size_t cp = 0; cp < kSize; ++cp) {
+            _fold[cp] = cp;
+            _cased[cp] = false;
+        }
+
+        for (const Range& r: ranges) {
+            for (size_t cp = r.first; cp <= r.last; cp += r.stride) {
+                _fold[cp] = cp + r.delta;
+                _cased[cp] = _cased[cp + r.delta] = true;
+            }
+        }
+    }
+
+    uint16_t _fold[kSize];
+    bool _cased[kSize];
+};
+
+// utf-8 case insensitive comparison of `s` with the text at `pos`
+inline bool EqualsUtf8Caseless(const TextView& text, size_t pos, const char * s, size_t len) {
+    if (pos + len > text.Size()) {
+        return false;
+    }
+
+    std::string t(len, 0);
+    for (size_t i = 0; i < len; ++i) {
+        t[i] = text[pos + i];
+    }
+
+    const Utf8Folding& utf8 = Utf8Folding::Instance();
+    return utf8.Fold(t.data(), len) == utf8.Fold(s, len);
+}
+
+} // StringAlgos
+
+#endif // CASEFOLDING_H
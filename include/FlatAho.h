@@ -0,0 +1,211 @@
+#ifndef FLATAHO_H
+#define FLATAHO_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+#include "PatternSearch.h"
+#include "SearchPolicies.h"
+
+namespace StringAlgos {
+
+// Aho-Corasick automaton in flat arrays, the policies are template parameters:
+// `AlphabetT` maps bytes to the columns of the transition table, `StateT` is the type of a state index,
+// so e.g. a dictionary of less than 64K states takes two bytes per transition.
+// There are no virtual calls, `Scan` is instantiated and inlined for every sink type (see SearchPolicies.h),
+// PolicySearch adapts the engine to PatternSearch. `Build` makes the automaton from scratch.
+template <typename DataT, typename AlphabetT = ByteAlphabet, typename StateT = uint32_t>
+class FlatAho {
+public:
+    typedef DataT Data;
+
+    FlatAho()
+        : _total(0)
+        , _distinct(0)
+    {
+        Build();
+    }
+
+    size_t Size() const {
+        return _patterns.size();
+    }
+
+    // the number of the distinct data of the built automaton, a scan finds no more of them
+    size_t Distinct() const {
+        return _distinct;
+    }
+
+    size_t States() const {
+        return _outBegin.size() - 1;
+    }
+
+    MemoryStats MemoryUsage() const {
+        MemoryStats res;
+        res.states = HeapBytes(_outBegin);
+        res.transitions = HeapBytes(_next);
+        res.outputs = HeapBytes(_outputs);
+
+        for (const auto& p: _patterns) {
+            res.patterns += sizeof(p) + kNodeOverhead + HeapBytes(p.first);
+        }
+
+        return res;
+    }
+
+    // returns false for the inserted pair, the empty pattern or if the states may not fit into `StateT`
+    bool Insert(const char * pattern, size_t len, const DataT& data) {
+        if (len == 0 || _total + len >= std::numeric_limits<StateT>::max()) {
+            return false;
+        }
+
+        if (!_patterns.insert(std::make_pair(std::string(pattern, len), data)).second) {
+            return false;
+        }
+
+        _total += len;
+        return true;
+    }
+
+    bool Delete(const char * pattern, size_t len, const DataT& data) {
+        if (!_patterns.erase(std::make_pair(std::string(pattern, len), data))) {
+            return false;
+        }
+
+        _total -= len;
+        return true;
+    }
+
+    void Build() {
+        std::vector<std::string> keys;
+        std::set<DataT> data;
+        keys.reserve(_patterns.size());
+        for (const auto& p: _patterns) {
+            keys.push_back(p.first);
+            data.insert(p.second);
+        }
+        _distinct = data.size();
+
+        _alphabet.Build(keys);
+        const size_t width = _alphabet.Size();
+
+        // trie, the root is 0 and no edge leads to it
+        _next.assign(width, 0);
+        std::vector<std::vector<DataT>> out(1);
+
+        for (const auto& p: _patterns) {
+            StateT s = 0;
+
+            for (char c: p.first) {
+                size_t i = s * width + _alphabet.Map(c);
+                if (!_next[i]) {
+                    _next[i] = out.size();
+                    out.emplace_back();
+                    _next.resize(_next.size() + width, 0);
+                }
+
+                s = _next[i];
+            }
+
+            out[s].push_back(p.second);
+        }
+
+        // bfs, the missing transitions are the ones of the failure link which is shallower
+        std::vector<StateT> link(out.size(), 0);
+        std::vector<StateT> queue;
+        queue.reserve(out.size());
+
+        for (size_t c = 0; c < width; ++c) {
+            if (_next[c]) {
+                queue.push_back(_next[c]);
+            }
+        }
+
+        for (size_t head = 0; head < queue.size(); ++head) {
+            StateT u = queue[head];
+
+            for (size_t c = 0; c < width; ++c) {
+                StateT& v = _next[u * width + c];
+                StateT linkNext = _next[link[u] * width + c];
+
+                if (!v) {
+                    v = linkNext;
+                    continue;
+                }
+
+                link[v] = linkNext;
+                out[v].insert(out[v].end(), out[linkNext].begin(), out[linkNext].end());
+                queue.push_back(v);
+            }
+        }
+
+        // outputs of the state `s` are [_outBegin[s], _outBegin[s + 1])
+        _outBegin.assign(1, 0);
+        _outputs.clear();
+        for (const std::vector<DataT>& o: out) {
+            _outputs.insert(_outputs.end(), o.begin(), o.end());
+            _outBegin.push_back(_outputs.size());
+        }
+    }
+
+    template <typename SinkT>
+    void Scan(const char * text, size_t len, SinkT& sink) const {
+        StateT state = 0;
+        ScanSegment(text, len, 0, state, sink);
+    }
+
+    // the state is carried from one segment to another
+    template <typename SinkT>
+    void Scan(const TextSegment * segments, size_t count, SinkT& sink) const {
+        StateT state = 0;
+        size_t offset = 0;
+
+        for (size_t i = 0; i < count; offset += segments[i].len, ++i) {
+            if (ScanSegment(segments[i].data, segments[i].len, offset, state, sink)) {
+                return;
+            }
+        }
+    }
+
+private:
+    // returns true if the sink has stopped the scan
+    template <typename SinkT>
+    bool ScanSegment(const char * text, size_t len, size_t offset, StateT& state, SinkT& sink) const {
+        const uchar_t * first = (const uchar_t *) text;
+        const StateT * next = _next.data();
+        const uint32_t * outBegin = _outBegin.data();
+        StateT s = state;
+
+        for (size_t i = 0; i < len; ++i) {
+            s = next[s * _alphabet.Size() + _alphabet.Map(first[i])];
+
+            if (outBegin[s] != outBegin[s + 1]) {
+                for (uint32_t j = outBegin[s]; j != outBegin[s + 1]; ++j) {
+                    if (sink(_outputs[j], offset + i + 1)) {
+                        state = s;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        state = s;
+        return false;
+    }
+
+private:
+    std::set<std::pair<std::string, DataT>> _patterns;
+    size_t _total; // sum of the lengths of the patterns, it bounds the number of states
+    size_t _distinct;
+
+    AlphabetT _alphabet;
+    std::vector<StateT> _next;
+    std::vector<uint32_t> _outBegin;
+    std::vector<DataT> _outputs;
+};
+
+} // StringAlgos
+
+#endif // FLATAHO_H
@@ -0,0 +1,184 @@
+#ifndef HITPROFILE_H
+#define HITPROFILE_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace StringAlgos {
+
+// the number of the sampled scans which found the pattern and the time of the last one
+struct PatternHits {
+    PatternHits()
+        : hits(0)
+    {}
+
+    uint64_t hits;
+    std::chrono::system_clock::time_point lastHit;
+};
+
+// Sampled profile of the scans: every `rate`-th Find of a thread records the found data and the visits of the states.
+// Each thread writes into its own buffer which is locked by the thread for the time of the sampled scan,
+// so the writers don't contend; the buffers are merged when the profile is read.
+// The scans which aren't sampled cost a relaxed load and the counter of the buffer, which the thread caches.
+template <typename DataT>
+class HitProfile {
+public:
+    struct Sample {
+        Sample()
+            : scans(0)
+            , tick(0)
+        {}
+
+        std::mutex m;
+        std::map<DataT, PatternHits> hits;
+        std::vector<uint64_t> visits; // by the index of a state
+        uint64_t scans;
+        uint64_t tick; // the scans of the thread, only it reads and writes it
+    };
+
+    HitProfile()
+        : _rate(0)
+        , _id(NextId())
+    {}
+
+    // `rate` = 1 records every scan
+    void Start(size_t rate) {
+        _rate.store(std::max<size_t>(rate, 1), std::memory_order_relaxed);
+    }
+
+    void Stop() {
+        _rate.store(0, std::memory_order_relaxed);
+    }
+
+    // the buffer of the calling thread if the scan is sampled, otherwise nullptr
+    Sample * Next() {
+        size_t rate = _rate.load(std::memory_order_relaxed);
+        if (!rate) {
+            return nullptr;
+        }
+
+        Sample * sample = ThreadSample();
+        return sample->tick++ % rate ? nullptr : sample;
+    }
+
+    void Record(Sample& sample, const std::set<DataT>& found) {
+        auto now = std::chrono::system_clock::now();
+        std::lock_guard<std::mutex> lock(sample.m);
+
+        ++sample.scans;
+        for (const DataT& data: found) {
+            PatternHits& h = sample.hits[data];
+            ++h.hits;
+            h.lastHit = now;
+        }
+    }
+
+    // the number of the sampled scans
+    uint64_t Scans() const {
+        uint64_t res = 0;
+        ForEach([&res](const Sample& sample) {
+            res += sample.scans;
+        });
+
+        return res;
+    }
+
+    std::map<DataT, PatternHits> Hits() const {
+        std::map<DataT, PatternHits> res;
+        ForEach([&res](const Sample& sample) {
+            for (const auto& e: sample.hits) {
+                PatternHits& h = res[e.first];
+                h.hits += e.second.hits;
+                h.lastHit = std::max(h.lastHit, e.second.lastHit);
+            }
+        });
+
+        return res;
+    }
+
+    std::vector<uint64_t> Visits() const {
+        std::vector<uint64_t> res;
+        ForEach([&res](const Sample& sample) {
+            if (res.size() < sample.visits.size()) {
+                res.resize(sample.visits.size());
+            }
+
+            for (size_t i = 0; i < sample.visits.size(); ++i) {
+                res[i] += sample.visits[i];
+            }
+        });
+
+        return res;
+    }
+
+    // the states are renumbered by the engine
+    void ResetVisits() {
+        ForEach([](Sample& sample) {
+            sample.visits.clear();
+        });
+    }
+
+    void Reset() {
+        ForEach([](Sample& sample) {
+            sample.hits.clear();
+            sample.visits.clear();
+            sample.scans = 0;
+        });
+    }
+
+private:
+    // the buffer of the calling thread, the thread caches the last one it used;
+    // the ids of the profiles aren't reused, so the cached buffer of another profile is never taken
+    Sample * ThreadSample() {
+        struct Cache {
+            uint64_t profile;
+            Sample * sample;
+        };
+
+        static thread_local Cache cache = {0, nullptr};
+        if (cache.profile == _id) {
+            return cache.sample;
+        }
+
+        std::lock_guard<std::mutex> lock(_m);
+        std::unique_ptr<Sample>& sample = _samples[std::this_thread::get_id()];
+        if (!sample) {
+            sample.reset(new Sample);
+        }
+
+        cache = Cache{_id, sample.get()};
+        return sample.get();
+    }
+
+    static uint64_t NextId() {
+        static std::atomic<uint64_t> next(0);
+        return ++next;
+    }
+
+    template <typename F>
+    void ForEach(F f) const {
+        std::lock_guard<std::mutex> lock(_m);
+        for (const auto& e: _samples) {
+            std::lock_guard<std::mutex> sampleLock(e.second->m);
+            f(*e.second);
+        }
+    }
+
+private:
+    std::atomic<size_t> _rate;
+    const uint64_t _id; // of the cache of the threads
+    mutable std::mutex _m;
+    std::map<std::thread::id, std::unique_ptr<Sample>> _samples;
+};
+
+} // StringAlgos
+
+#endif // HITPROFILE_H
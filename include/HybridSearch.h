@@ -0,0 +1,132 @@
+#ifndef HYBRIDSEARCH_H
+#define HYBRIDSEARCH_H
+
+#include <string>
+#include <cstring>
+#include <cctype>
+
+#include "PatternSearch.h"
+#include "Aho.h"
+#include "Hyperscan.h"
+
+namespace StringAlgos {
+
+// Patterns which are plain strings are searched by Aho, the real regexs - by Hyperscan.
+// A regex without special characters (escaped punctuation is allowed) is a literal too,
+// so "a\.b" and "a.b" with kLiteral are the same rule. Aho handles kCaseless, kUtf8 and position options of literals itself.
+template <typename DataT>
+class HybridSearch : public PatternSearch<DataT>
+{
+public:
+    using PatternSearch<DataT>::Insert;
+    using PatternSearch<DataT>::Delete;
+    using PatternSearch<DataT>::Find;
+
+    // `defaults` are the options of the patterns inserted without options
+    explicit HybridSearch(const PatternOptions& defaults = PatternOptions())
+        : _defaults(defaults)
+    {}
+
+    void Build() override {
+        _literals.Build();
+        _regexs.Build();
+    }
+
+    size_t Size() const override {
+        return _literals.Size() + _regexs.Size();
+    }
+
+    MemoryStats MemoryUsage() const override {
+        MemoryStats res = _literals.MemoryUsage();
+        res += _regexs.MemoryUsage();
+        return res;
+    }
+
+    bool Insert(const char * pattern, size_t len, const DataT& data) override {
+        return Insert(pattern, len, data, _defaults);
+    }
+
+    bool Delete(const char * pattern, size_t len, const DataT& data) override {
+        return Delete(pattern, len, data, _defaults);
+    }
+
+    bool Insert(const char * pattern, size_t len, const DataT& data, const PatternOptions& options) override {
+        std::string literal;
+        if (ToLiteral(pattern, len, options, literal)) {
+            return _literals.Insert(literal.data(), literal.size(), data, options);
+        }
+
+        return _regexs.Insert(pattern, len, data, options);
+    }
+
+    bool Delete(const char * pattern, size_t len, const DataT& data, const PatternOptions& options) override {
+        std::string literal;
+        if (ToLiteral(pattern, len, options, literal)) {
+            return _literals.Delete(literal.data(), literal.size(), data, options);
+        }
+
+        return _regexs.Delete(pattern, len, data, options);
+    }
+
+    std::set<DataT> Find(const char * text, size_t len) const override {
+        std::set<DataT> res = _literals.Find(text, len);
+        std::set<DataT> regexRes = _regexs.Find(text, len);
+        res.insert(regexRes.begin(), regexRes.end());
+
+        return res;
+    }
+
+    std::set<DataT> Find(const TextSegment * segments, size_t count) const override {
+        std::set<DataT> res = _literals.Find(segments, count);
+        std::set<DataT> regexRes = _regexs.Find(segments, count);
+        res.insert(regexRes.begin(), regexRes.end());
+
+        return res;
+    }
+
+    // returns true if the pattern matches only one string, it's written to `literal`
+    static bool ToLiteral(const char * pattern, size_t len, const PatternOptions& options, std::string& literal) {
+        // options which are meaningful only for the regex engine
+        const unsigned literalOptions = PatternOptions::kLiteral | PatternOptions::kCaseless | PatternOptions::kAnchoredStart |
+                                        PatternOptions::kAnchoredEnd | PatternOptions::kWordBoundary | PatternOptions::kUtf8;
+        if (options.flags & ~literalOptions) {
+            return false;
+        }
+
+        if (options.Has(PatternOptions::kLiteral)) {
+            literal.assign(pattern, len);
+            return true;
+        }
+
+        literal.clear();
+        literal.reserve(len);
+
+        for (size_t i = 0; i < len; ++i) {
+            char c = pattern[i];
+
+            if (c == '\\') {
+                // \d, \w, \x41, ... are classes or codes, only escaped punctuation is a plain character
+                if (i + 1 == len || !ispunct((uchar_t) pattern[i + 1])) {
+                    return false;
+                }
+
+                literal.push_back(pattern[++i]);
+            } else if (c != '\0' && strchr(".^$|?*+()[]{}", c)) {
+                return false;
+            } else {
+                literal.push_back(c);
+            }
+        }
+
+        return !literal.empty();
+    }
+
+private:
+    Aho<DataT> _literals;
+    Hyperscan<DataT> _regexs;
+    PatternOptions _defaults;
+};
+
+} // StringAlgos
+
+#endif // HYBRIDSEARCH_H
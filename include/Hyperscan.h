@@ -10,10 +10,19 @@
 #include <cstring>
 #include <cassert>
 #include <algorithm>
+#include <numeric>
+#include <functional>
+#include <unordered_map>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <limits>
 
 #include <hs.h>
 #include <PatternSearch.h>
+#include <ScanStats.h>
 #include <psc/utils/thread.h>
 #include <psc/utils/smart_ptr.h>
 
@@ -25,37 +34,67 @@ private:
     struct Context {
         std::set<DataT> * res;
         const std::vector<DataT> * data;
+        ScanStats * stats;
     };
 
-    class DatabaseWrapper {
-    public:
-        DatabaseWrapper(const std::vector<char *>& patterns, const std::vector<DataT>& data)
-            : data(data)
-        {
-            assert(!patterns.empty());
+    // <pattern, data, options> is the identity of a rule; pattern is length-delimited
+    struct PatternKey {
+        std::string pattern;
+        DataT data;
+        PatternOptions options;
 
-            // flags is a vector = {HS_FLAG_SINGLEMATCH, HS_FLAG_SINGLEMATCH, ...} n times
-            // ids = 1..n
-            // n = max of _patterns.size() from all instances of Hyperscan
-            static std::vector<unsigned> flags;
-            static std::vector<unsigned> ids;
+        bool operator==(const PatternKey& other) const {
+            return data == other.data && options == other.options && pattern == other.pattern;
+        }
+    };
 
-            // if we inserted new patterns to `_paterrns` from previous Init call
-            if (patterns.size() > flags.size()) {
-                int prev_sz = flags.size();
+    struct PatternKeyHash {
+        size_t operator()(const PatternKey& key) const {
+            size_t h = std::hash<std::string>()(key.pattern) ^ key.options.flags;
+            return h ^ (std::hash<DataT>()(key.data) + 0x9e3779b9 + (h << 6) + (h >> 2));
+        }
+    };
 
-                flags.resize(patterns.size());
-                ids.resize(patterns.size());
+    // maps every rule to its slot in the shard of the rule,
+    // slots are a dense array of the rules of the shard,
+    // references to the elements of unordered_map are stable, so slots point right into the index
+    typedef std::unordered_map<PatternKey, size_t, PatternKeyHash> PatternIndex;
+    typedef typename PatternIndex::value_type PatternEntry;
 
-                std::fill_n(flags.begin() + prev_sz, flags.size() - prev_sz, HS_FLAG_SINGLEMATCH);
-                std::iota(ids.begin() + prev_sz, ids.end(), prev_sz);
+    // literal databases are compiled by hs_compile_lit_multi (hyperscan >= 5.2):
+    // patterns aren't parsed and may contain any bytes including '\0'
+    class DatabaseWrapper {
+    public:
+        DatabaseWrapper(const std::vector<const PatternKey *>& rules, bool literal, unsigned mode)
+            : mode(mode)
+        {
+            assert(!rules.empty());
+
+            std::vector<const char *> patterns;
+            std::vector<size_t> lens;
+            std::vector<unsigned> flags;
+            std::vector<unsigned> ids(rules.size());
+            patterns.reserve(rules.size());
+            lens.reserve(rules.size());
+            flags.reserve(rules.size());
+            data.reserve(rules.size());
+
+            for (const PatternKey * k: rules) {
+                patterns.push_back(k->pattern.c_str());
+                lens.push_back(k->pattern.size());
+                flags.push_back(HsFlags(k->options, literal));
+                data.push_back(k->data);
             }
 
-            static const unsigned int mode = HS_MODE_BLOCK;
+            // id of a pattern is its index in `data`
+            std::iota(ids.begin(), ids.end(), 0);
 
             hs_compile_error_t *compileErr;
-            hs_error_t err = hs_compile_multi(patterns.data(), flags.data(), ids.data(),
-                                              patterns.size(), mode, nullptr, &db, &compileErr);
+            hs_error_t err = literal
+                    ? hs_compile_lit_multi(patterns.data(), flags.data(), ids.data(), lens.data(),
+                                           patterns.size(), mode, nullptr, &db, &compileErr)
+                    : hs_compile_multi(patterns.data(), flags.data(), ids.data(),
+                                       patterns.size(), mode, nullptr, &db, &compileErr);
 
             if (err != HS_SUCCESS) {
                 if (compileErr->expression < 0) {
@@ -87,9 +126,45 @@ private:
             hs_free_scratch(scratch);
         }
 
+        static unsigned HsFlags(const PatternOptions& options, bool literal) {
+            unsigned flags = 0;
+
+            if (options.Has(PatternOptions::kCaseless))    flags |= HS_FLAG_CASELESS;
+            if (options.Has(PatternOptions::kSomLeftmost)) flags |= HS_FLAG_SOM_LEFTMOST;
+
+            // literal databases accept only CASELESS, SINGLEMATCH and SOM_LEFTMOST
+            if (!literal) {
+                if (options.Has(PatternOptions::kDotAll))    flags |= HS_FLAG_DOTALL;
+                if (options.Has(PatternOptions::kMultiLine)) flags |= HS_FLAG_MULTILINE;
+                if (options.Has(PatternOptions::kUtf8))      flags |= HS_FLAG_UTF8 | HS_FLAG_UCP;
+            }
+
+            // we need only the first match of each pattern,
+            // but SINGLEMATCH can't be combined with SOM_LEFTMOST
+            if (!(flags & HS_FLAG_SOM_LEFTMOST)) {
+                flags |= HS_FLAG_SINGLEMATCH;
+            }
+
+            return flags;
+        }
+
         hs_database_t * db = nullptr;
         hs_scratch_t * scratch = nullptr;
         std::vector<DataT> data;
+        unsigned mode;
+    };
+
+    // rules are distributed among shards by hash of the pattern,
+    // every shard is compiled to its own databases and only changed shards are recompiled
+    struct Shard {
+        std::vector<PatternEntry *> slots;
+        bool dirty = false;
+    };
+
+    // databases visible to Find, they aren't modified after publishing;
+    // regex and literal databases of the i-th shard are [2 * i] and [2 * i + 1], null if empty
+    struct Snapshot {
+        std::vector<psc::smart_ptr<DatabaseWrapper>> databases;
     };
 
     struct ScratchWrapper {
@@ -114,95 +189,398 @@ public:
     using PatternSearch<DataT>::Insert;
     using PatternSearch<DataT>::Delete;
 
+    // `defaults` are options of the patterns inserted without explicit ones,
+    // e.g. PatternOptions(PatternOptions::kLiteral) makes the whole instance literal;
+    // shards are compiled in parallel and a change of one rule recompiles only its shard;
+    // `mode` is HS_MODE_BLOCK or HS_MODE_VECTORED, the latter scans scattered text without copying
+    explicit Hyperscan(const PatternOptions& defaults = PatternOptions(), size_t shards = 1,
+                       unsigned mode = HS_MODE_BLOCK)
+        : _defaults(defaults)
+        , _mode(mode)
+        , _shards(std::max<size_t>(shards, 1))
+    {
+        assert(mode == HS_MODE_BLOCK || mode == HS_MODE_VECTORED);
+
+        _snapshot = new Snapshot;
+        _snapshot->databases.resize(2 * _shards.size());
+    }
+
     ~Hyperscan() {
-        for (char* c: _patterns) {
-            delete[] c;
-        }
+        StopBackgroundBuild();
     }
 
     void Build() override {
-        psc::smart_ptr<DatabaseWrapper> dw;
+        Compile();
+    }
 
-        if (!_patterns.empty())
-            dw = new DatabaseWrapper(_patterns, _data);
+    // Background build mode: every modification marks the rule set dirty and
+    // the builder thread compiles it when no modifications came during `window`
+    // (but not later than `maxDelay` after the first one), so a burst of updates costs one compile.
+    // Find keeps scanning the previous databases until the new ones are published.
+    void StartBackgroundBuild(std::chrono::milliseconds window,
+                              std::chrono::milliseconds maxDelay = std::chrono::milliseconds(1000)) {
+        StopBackgroundBuild();
+
+        std::lock_guard<std::mutex> lock(_updateMutex);
+        _window = window;
+        _maxDelay = std::max(window, maxDelay);
+        _stopBuilder = false;
+        _builder = std::thread(&Hyperscan::BackgroundBuild, this);
+    }
 
-        _m.lock();
-        _dw = dw;
-        _m.unlock();
+    void StopBackgroundBuild() {
+        {
+            std::lock_guard<std::mutex> lock(_updateMutex);
+            _stopBuilder = true;
+        }
+        _updated.notify_all();
+
+        if (_builder.joinable()) {
+            _builder.join();
+        }
+    }
+
+    // version of the rule set, it's increased by every successful Insert/Delete
+    uint64_t Version() const {
+        std::lock_guard<std::mutex> lock(_updateMutex);
+        return _version;
+    }
+
+    // version of the rule set which is visible to Find
+    uint64_t Generation() const {
+        std::lock_guard<std::mutex> lock(_updateMutex);
+        return _generation;
+    }
+
+    // returns false if `generation` hasn't been published during `timeout`
+    bool WaitForGeneration(uint64_t generation, std::chrono::milliseconds timeout) const {
+        std::unique_lock<std::mutex> lock(_updateMutex);
+        return _published.wait_for(lock, timeout, [this, generation]() { return _generation >= generation; });
     }
 
     size_t Size() const override {
-        return _patterns.size();
+        std::lock_guard<std::mutex> lock(_updateMutex);
+        return _index.size();
     }
 
-    bool Insert(const char *pattern, size_t len, const DataT& data) override {
-        for (size_t i = 0; i < _patterns.size(); ++i) {
-            if (strcmp(_patterns[i], pattern) == 0 && _data[i] == data) {
-                return false;
+    size_t Shards() const {
+        return _shards.size();
+    }
+
+    // the rules and the published databases, every database has its own prototype scratch
+    MemoryStats MemoryUsage() const override {
+        MemoryStats res;
+
+        {
+            std::lock_guard<std::mutex> lock(_updateMutex);
+            res.patterns += _index.bucket_count() * sizeof(void *);
+            for (const PatternEntry& e: _index) {
+                res.patterns += sizeof(PatternEntry) + kNodeOverhead + HeapBytes(e.first.pattern);
+            }
+
+            for (const Shard& shard: _shards) {
+                res.patterns += HeapBytes(shard.slots);
             }
         }
 
-        char * cpy = new char[len + 1];
-        strcpy(cpy, pattern);
-        _patterns.push_back(cpy);
-        _data.push_back(data);
+        _m.lock();
+        psc::smart_ptr<Snapshot> snapshot = _snapshot;
+        _m.unlock();
+
+        for (const psc::smart_ptr<DatabaseWrapper>& dw: snapshot->databases) {
+            if (!dw) {
+                continue;
+            }
 
-        return true;
+            size_t size = 0;
+            if (dw->db && hs_database_size(dw->db, &size) == HS_SUCCESS) {
+                res.database += size;
+            }
+
+            if (dw->scratch && hs_scratch_size(dw->scratch, &size) == HS_SUCCESS) {
+                res.scratch += size;
+            }
+
+            res.outputs += HeapBytes(dw->data);
+        }
+
+        return res;
+    }
+
+    bool Insert(const char *pattern, size_t len, const DataT& data) override {
+        return Insert(pattern, len, data, _defaults);
     }
 
     bool Delete(const char *pattern, size_t len, const DataT& data) override {
-        for (size_t i = 0; i < _patterns.size(); ++i) {
-            if (strcmp(_patterns[i], pattern) == 0 && _data[i] == data) {
+        return Delete(pattern, len, data, _defaults);
+    }
+
+    // position options of literal engines aren't supported, regexs have '^', '$' and '\b' for them
+    bool Insert(const char *pattern, size_t len, const DataT& data, const PatternOptions& options) override {
+        if (options.flags & (PatternOptions::kAnchoredStart | PatternOptions::kAnchoredEnd | PatternOptions::kWordBoundary)) {
+            return false;
+        }
 
-                std::swap(_patterns[i], _patterns.back());
-                std::swap(_data[i], _data.back());
+        PatternKey key{std::string(pattern, len), data, options};
+        Shard& shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock(_updateMutex);
 
-                delete[] _patterns.back();
-                _patterns.pop_back();
-                _data.pop_back();
+        auto r = _index.emplace(std::move(key), shard.slots.size());
+        if (!r.second) {
+            return false;
+        }
 
-                return true;
-            }
+        shard.slots.push_back(&*r.first);
+        MarkDirty(shard);
+        return true;
+    }
+
+    bool Delete(const char *pattern, size_t len, const DataT& data, const PatternOptions& options) override {
+        PatternKey key{std::string(pattern, len), data, options};
+        Shard& shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock(_updateMutex);
+
+        auto it = _index.find(key);
+        if (it == _index.end()) {
+            return false;
         }
 
-        return false;
+        // move the last slot to the place of deleted one
+        std::vector<PatternEntry *>& slots = shard.slots;
+        size_t slot = it->second;
+        slots[slot] = slots.back();
+        slots[slot]->second = slot;
+        slots.pop_back();
+
+        _index.erase(it);
+        MarkDirty(shard);
+        return true;
     }
 
     std::set<DataT> Find(const char *text, size_t len) const override {
+        TextSegment segment{text, len};
+        return Scan(&segment, 1);
+    }
+
+    std::set<DataT> Find(const TextSegment * segments, size_t count) const override {
+        if (_mode != HS_MODE_VECTORED) {
+            return PatternSearch<DataT>::Find(segments, count);
+        }
+
+        return Scan(segments, count);
+    }
+
+private:
+    Shard& ShardOf(const PatternKey& key) {
+        return _shards[std::hash<std::string>()(key.pattern) % _shards.size()];
+    }
+
+    // should be called under `_updateMutex`
+    void MarkDirty(Shard& shard) {
+        shard.dirty = true;
+        ++_version;
+        _updated.notify_all();
+    }
+
+    // Only dirty shards are compiled, each by its own thread, regexes and literals to the separate databases.
+    // Rules are copied so modifications aren't blocked during compilation,
+    // compilations are serialized: every one starts from the previously published snapshot.
+    void Compile() {
+        std::lock_guard<std::mutex> compileLock(_compileMutex);
+
+        std::vector<size_t> dirty;
+        std::vector<std::vector<PatternKey>> rules;
+        uint64_t version;
+        {
+            std::lock_guard<std::mutex> lock(_updateMutex);
+            for (size_t i = 0; i < _shards.size(); ++i) {
+                if (!_shards[i].dirty) {
+                    continue;
+                }
+
+                dirty.push_back(i);
+                rules.emplace_back();
+                rules.back().reserve(_shards[i].slots.size());
+                for (const PatternEntry * e: _shards[i].slots) {
+                    rules.back().push_back(e->first);
+                }
+                _shards[i].dirty = false;
+            }
+            version = _version;
+        }
+
+        psc::smart_ptr<Snapshot> snapshot;
+        snapshot = new Snapshot;
+
         _m.lock();
-        psc::smart_ptr<DatabaseWrapper> dw = _dw;
+        snapshot->databases = _snapshot->databases;
         _m.unlock();
 
+        std::vector<std::thread> compilers;
+        for (size_t i = 1; i < dirty.size(); ++i) {
+            compilers.emplace_back(&Hyperscan::CompileShard, std::ref(rules[i]), _mode,
+                                   std::ref(snapshot->databases[2 * dirty[i]]),
+                                   std::ref(snapshot->databases[2 * dirty[i] + 1]));
+        }
+
+        if (!dirty.empty()) {
+            CompileShard(rules[0], _mode, snapshot->databases[2 * dirty[0]], snapshot->databases[2 * dirty[0] + 1]);
+        }
+
+        for (std::thread& t: compilers) {
+            t.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_updateMutex);
+
+            _m.lock();
+            std::swap(_snapshot, snapshot);
+            _m.unlock();
+
+            _generation = version;
+        }
+        _published.notify_all();
+
+        // previous databases are released here if no Find uses them
+    }
+
+    static void CompileShard(const std::vector<PatternKey>& rules, unsigned mode,
+                             psc::smart_ptr<DatabaseWrapper>& dw,
+                             psc::smart_ptr<DatabaseWrapper>& literalDw) {
+        std::vector<const PatternKey *> regexs;
+        std::vector<const PatternKey *> literals;
+
+        for (const PatternKey& k: rules) {
+            if (k.options.Has(PatternOptions::kLiteral)) {
+                literals.push_back(&k);
+            } else {
+                regexs.push_back(&k);
+            }
+        }
+
+        dw = psc::smart_ptr<DatabaseWrapper>();
+        literalDw = psc::smart_ptr<DatabaseWrapper>();
+
+        if (!regexs.empty())
+            dw = new DatabaseWrapper(regexs, false, mode);
+
+        if (!literals.empty())
+            literalDw = new DatabaseWrapper(literals, true, mode);
+    }
+
+    void BackgroundBuild() {
+        typedef std::chrono::steady_clock clock;
+        std::unique_lock<std::mutex> lock(_updateMutex);
+
+        while (true) {
+            _updated.wait(lock, [this]() { return _stopBuilder || _version != _generation; });
+            if (_stopBuilder) {
+                break;
+            }
+
+            // coalesce the burst of modifications
+            const clock::time_point deadline = clock::now() + _maxDelay;
+            uint64_t seen;
+            do {
+                seen = _version;
+                _updated.wait_until(lock, std::min(clock::now() + _window, deadline),
+                                    [this, seen]() { return _stopBuilder || _version != seen; });
+            } while (!_stopBuilder && _version != seen && clock::now() < deadline);
+
+            if (_stopBuilder) {
+                break;
+            }
+
+            lock.unlock();
+            Compile();
+            lock.lock();
+        }
+    }
+
+    // there is only one segment in the block mode
+    std::set<DataT> Scan(const TextSegment * segments, size_t count) const {
+        _m.lock();
+        psc::smart_ptr<Snapshot> snapshot = _snapshot;
+        _m.unlock();
+
+        // the lengths of Hyperscan are unsigned: the longer segments are split into several entries of the vector,
+        // the block can't be split, so a longer one is an error
+        const size_t maxLen = std::numeric_limits<unsigned>::max();
+        std::vector<const char *> data;
+        std::vector<unsigned> lens;
+        if (_mode == HS_MODE_VECTORED) {
+            data.reserve(count);
+            lens.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                for (size_t pos = 0; pos == 0 || pos < segments[i].len; pos += maxLen) {
+                    data.push_back(segments[i].data + pos);
+                    lens.push_back(std::min(segments[i].len - pos, maxLen));
+                }
+            }
+        } else if (segments[0].len > maxLen) {
+            std::cerr << "ERROR: The block is too long for Hyperscan" << std::endl;
+            return std::set<DataT>();
+        }
+
         std::set<DataT> res;
-        if (!dw) return res;
+        ScanStats stats;
+
+        // all databases report to the same result set
+        for (const psc::smart_ptr<DatabaseWrapper>& dw: snapshot->databases) {
+            if (!dw) {
+                continue;
+            }
+
+            assert(dw->scratch);
+            ScratchWrapper sw(dw->scratch);
+            Context ctx{&res, &dw->data, &stats};
+            SCAN_STAT(for (size_t i = 0; i < count; ++i) stats.bytes += segments[i].len);
 
-        assert(dw->scratch);
-        ScratchWrapper sw(dw->scratch);
-        Context ctx{&res, &dw->data};
+            hs_error_t err = (_mode == HS_MODE_VECTORED)
+                    ? hs_scan_vector(dw->db, data.data(), lens.data(), data.size(), 0, sw.scratch, FindHandler, (void*) &ctx)
+                    : hs_scan(dw->db, segments[0].data, segments[0].len, 0, sw.scratch, FindHandler, (void*) &ctx);
 
-        if (hs_scan(dw->db, text, len, 0, sw.scratch, FindHandler, (void*) &ctx) != HS_SUCCESS) {
-            std::cerr << "ERROR: Unable to scan input buffer" << std::endl;
-            std::cerr << text << " " << len << std::endl;
-            res.clear();
+            if (err != HS_SUCCESS) {
+                std::cerr << "ERROR: Unable to scan input buffer" << std::endl;
+                res.clear();
+                break;
+            }
         }
 
+        SCAN_STAT(++stats.scans; AddScanStats(stats));
         return res;
     }
 
-private:
     static int FindHandler(unsigned int id, unsigned long long from,
                             unsigned long long to, unsigned int flags, void * ctx) {
         Context * context = reinterpret_cast<Context *>(ctx);
         context->res->insert((*context->data)[id]);
+        SCAN_STAT(++context->stats->matches);
 
         return 0;
     }
 
 private:
-    std::vector<char *> _patterns;
-    std::vector<DataT> _data;
-    psc::smart_ptr<DatabaseWrapper> _dw;
+    PatternOptions _defaults;
+    unsigned _mode;
+    PatternIndex _index;
+    std::vector<Shard> _shards;
+    psc::smart_ptr<Snapshot> _snapshot;
     mutable psc::threads::mutex _m;
+
+    // guards the rule set, versions and the builder state
+    mutable std::mutex _updateMutex;
+    std::mutex _compileMutex;
+    mutable std::condition_variable _published;
+    std::condition_variable _updated;
+    uint64_t _version = 0;
+    uint64_t _generation = 0;
+
+    std::thread _builder;
+    bool _stopBuilder = false;
+    std::chrono::milliseconds _window;
+    std::chrono::milliseconds _maxDelay;
 };
 
 } // StringAlgos
@@ -12,12 +12,25 @@ template <typename DataT>
 class LinearSearch : public PatternSearch<DataT>
 {
 public:
+    using PatternSearch<DataT>::Insert;
+    using PatternSearch<DataT>::Delete;
+    using PatternSearch<DataT>::Find;
+
     LinearSearch() {}
 
     size_t Size() const override {
         return _patterns.size();
     }
 
+    MemoryStats MemoryUsage() const override {
+        MemoryStats res;
+        for (const auto& pp: _patterns) {
+            res.patterns += sizeof(pp) + kNodeOverhead + HeapBytes(pp.first);
+        }
+
+        return res;
+    }
+
     bool Insert(const char * pattern, size_t len, const DataT& data) override {
         return Insert(std::string(pattern, pattern + len), data);
     }
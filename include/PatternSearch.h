@@ -4,12 +4,330 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <cstring>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
 
 namespace StringAlgos {
 
 typedef unsigned char uchar_t;
 typedef const unsigned char * uchar_ptr_t;
 
+// options of a single pattern, they are a part of pattern identity: Delete should get the same options as Insert
+struct PatternOptions {
+    enum Flag : unsigned {
+        kNone    = 0,
+        kLiteral     = 1u << 0, // pattern is a plain string, regex engines mustn't parse it
+        kCaseless    = 1u << 1, // ascii case insensitive matching
+        kDotAll      = 1u << 2, // '.' matches '\n' too
+        kMultiLine   = 1u << 3, // '^' and '$' match at line boundaries
+        kSomLeftmost = 1u << 4, // regex engine has to track the leftmost start of a match
+
+        // positions of a match, they are supported only by literal engines, regexs have '^', '$' and '\b'
+        kAnchoredStart = 1u << 5, // the match starts at the beginning of the text
+        kAnchoredEnd   = 1u << 6, // the match ends at the end of the text
+        kWordBoundary  = 1u << 7, // the match is a whole word: there are no word characters right before and after it
+
+        kUtf8 = 1u << 8, // pattern and text are utf-8, kCaseless folds non-ascii letters too
+    };
+
+    explicit PatternOptions(unsigned flags = kNone)
+        : flags(flags)
+    {}
+
+    bool Has(Flag flag) const {
+        return flags & flag;
+    }
+
+    bool operator==(const PatternOptions& other) const {
+        return flags == other.flags;
+    }
+
+    unsigned flags;
+};
+
+// a piece of the scattered text, like struct iovec
+struct TextSegment {
+    const char * data;
+    size_t len;
+};
+
+// random access to the bytes of the scattered text by the offset from its beginning,
+// literal engines use it only to check the text around a match
+class TextView {
+public:
+    TextView(const TextSegment * segments, size_t count)
+        : _segments(segments)
+        , _count(count)
+        , _size(0)
+    {
+        if (count > 1) {
+            _offsets.reserve(count);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (count > 1) {
+                _offsets.push_back(_size);
+            }
+            _size += segments[i].len;
+        }
+    }
+
+    size_t Size() const {
+        return _size;
+    }
+
+    uchar_t operator[](size_t pos) const {
+        if (_count == 1) {
+            return _segments->data[pos];
+        }
+
+        // the last segment which starts at `pos` or before, so empty segments are skipped
+        size_t i = std::upper_bound(_offsets.begin(), _offsets.end(), pos) - _offsets.begin() - 1;
+        return _segments[i].data[pos - _offsets[i]];
+    }
+
+    // is `s` at `pos` of the text
+    bool Equals(size_t pos, const char * s, size_t len) const {
+        if (pos + len > _size) {
+            return false;
+        }
+
+        if (_count == 1) {
+            return memcmp(_segments->data + pos, s, len) == 0;
+        }
+
+        for (size_t i = 0; i < len; ++i) {
+            if ((*this)[pos + i] != (uchar_t) s[i]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    const TextSegment * _segments;
+    size_t _count;
+    size_t _size;
+    std::vector<size_t> _offsets;
+};
+
+// ascii alphanumerics and '_' like in '\w' of regexs
+inline bool IsWordChar(uchar_t c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// does the match [begin, end) of the text satisfy the position options of its pattern
+inline bool IsPlaced(const PatternOptions& options, const TextView& text, size_t begin, size_t end) {
+    if (options.Has(PatternOptions::kAnchoredStart) && begin != 0) {
+        return false;
+    }
+
+    if (options.Has(PatternOptions::kAnchoredEnd) && end != text.Size()) {
+        return false;
+    }
+
+    if (options.Has(PatternOptions::kWordBoundary)) {
+        if ((begin > 0 && IsWordChar(text[begin - 1])) || (end < text.Size() && IsWordChar(text[end]))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// bytes of memory of an engine by category, the overhead of the allocator isn't counted
+struct MemoryStats {
+    MemoryStats()
+        : states(0)
+        , transitions(0)
+        , outputs(0)
+        , patterns(0)
+        , database(0)
+        , scratch(0)
+    {}
+
+    size_t Total() const {
+        return states + transitions + outputs + patterns + database + scratch;
+    }
+
+    MemoryStats& operator+=(const MemoryStats& other) {
+        states += other.states;
+        transitions += other.transitions;
+        outputs += other.outputs;
+        patterns += other.patterns;
+        database += other.database;
+        scratch += other.scratch;
+        return *this;
+    }
+
+    size_t states;      // vertices of the tries and automata without their transitions
+    size_t transitions; // edges of the tries and rows of transitions
+    size_t outputs;     // data reported by the states, ids of the data
+    size_t patterns;    // copies of the patterns and the containers of the rules
+    size_t database;    // compiled hyperscan databases, hs_database_size
+    size_t scratch;     // hyperscan scratch, hs_scratch_size; `Find` clones it for the time of the scan
+};
+
+// a node of std::set, std::map or a list of std::unordered_map besides the element
+static const size_t kNodeOverhead = 4 * sizeof(void *);
+
+// the buffer of the string, zero if it's short and is kept inside the object
+inline size_t HeapBytes(const std::string& s) {
+    const char * p = s.data();
+    bool inside = p >= (const char *) &s && p < (const char *) (&s + 1);
+    return inside ? 0 : s.capacity() + 1;
+}
+
+template <typename T>
+size_t HeapBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+// up to 8 first bytes of a string, the tail of a long pattern is compared with the text by them before memcmp,
+// so a mismatch doesn't touch the memory of the pattern
+inline uint64_t Fingerprint(const char * s, size_t len) {
+    uint64_t res = 0;
+    for (size_t i = 0; i < len && i < 8; ++i) {
+        res |= uint64_t((uchar_t) s[i]) << (8 * i);
+    }
+
+    return res;
+}
+
+inline uint64_t Fingerprint(const TextView& text, size_t pos, size_t len) {
+    uint64_t res = 0;
+    for (size_t i = 0; i < len && i < 8; ++i) {
+        res |= uint64_t(text[pos + i]) << (8 * i);
+    }
+
+    return res;
+}
+
+// Dense ids of the data of the patterns: an engine keeps the ids in its outputs, the scan marks them in FoundIds
+// and they are translated to the data only at the end. Patterns with the same data share the id.
+template <typename DataT>
+class DataIds {
+public:
+    // the id of `data`, a new one or the one of the other pattern with the same data
+    uint32_t Acquire(const DataT& data) {
+        auto it = _ids.find(data);
+        if (it != _ids.end()) {
+            ++_refs[it->second];
+            return it->second;
+        }
+
+        uint32_t id;
+        if (_free.empty()) {
+            id = _data.size();
+            _data.push_back(data);
+            _refs.push_back(1);
+        } else {
+            id = _free.back();
+            _free.pop_back();
+            _data[id] = data;
+            _refs[id] = 1;
+        }
+
+        _ids.emplace(data, id);
+        return id;
+    }
+
+    // a pattern with `data` is deleted, the id is free when it was the last one
+    void Release(const DataT& data) {
+        auto it = _ids.find(data);
+        assert(it != _ids.end());
+
+        if (--_refs[it->second] == 0) {
+            _free.push_back(it->second);
+            _ids.erase(it);
+        }
+    }
+
+    // returns false if there is no pattern with `data`
+    bool Find(const DataT& data, uint32_t& id) const {
+        auto it = _ids.find(data);
+        if (it == _ids.end()) {
+            return false;
+        }
+
+        id = it->second;
+        return true;
+    }
+
+    const DataT& Data(uint32_t id) const {
+        return _data[id];
+    }
+
+    // number of the distinct data
+    size_t Size() const {
+        return _ids.size();
+    }
+
+    // all ids are less than it
+    size_t Bound() const {
+        return _data.size();
+    }
+
+    size_t MemoryUsage() const {
+        return _ids.size() * (sizeof(typename std::map<DataT, uint32_t>::value_type) + kNodeOverhead) +
+               HeapBytes(_data) + HeapBytes(_refs) + HeapBytes(_free);
+    }
+
+private:
+    std::map<DataT, uint32_t> _ids;
+    std::vector<DataT> _data;
+    std::vector<size_t> _refs;
+    std::vector<uint32_t> _free;
+};
+
+// the ids found by a scan, the number of the set bits is counted by `Add`,
+// so the check that all data are found is a single comparison
+class FoundIds {
+public:
+    explicit FoundIds(size_t bound)
+        : _words((bound + 63) / 64)
+        , _count(0)
+    {}
+
+    void Add(uint32_t id) {
+        uint64_t& word = _words[id >> 6];
+        uint64_t bit = uint64_t(1) << (id & 63);
+
+        _count += !(word & bit);
+        word |= bit;
+    }
+
+    void Add(const std::vector<uint32_t>& ids) {
+        for (uint32_t id: ids) {
+            Add(id);
+        }
+    }
+
+    size_t Count() const {
+        return _count;
+    }
+
+    template <typename DataT>
+    std::set<DataT> Data(const DataIds<DataT>& ids) const {
+        std::set<DataT> res;
+        for (size_t i = 0; i < _words.size(); ++i) {
+            for (uint64_t bits = _words[i]; bits; bits &= bits - 1) {
+                res.insert(ids.Data(i * 64 + __builtin_ctzll(bits)));
+            }
+        }
+
+        return res;
+    }
+
+private:
+    std::vector<uint64_t> _words;
+    size_t _count;
+};
+
 template<typename DataT>
 class PatternSearch
 {
@@ -20,6 +338,11 @@ public:
     virtual void Build() {}
     virtual size_t Size() const = 0;
 
+    // the footprint of the engine, engines which don't count it return zeros
+    virtual MemoryStats MemoryUsage() const {
+        return MemoryStats();
+    }
+
     virtual bool Insert(const std::string &pattern, const DataT& data) {
         return Insert(pattern.c_str(), pattern.size(), data);
     }
@@ -36,6 +359,40 @@ public:
         return Find(text.c_str(), text.size());
     }
 
+    virtual bool Insert(const std::string &pattern, const DataT& data, const PatternOptions& options) {
+        return Insert(pattern.c_str(), pattern.size(), data, options);
+    }
+
+    virtual bool Delete(const std::string &pattern, const DataT& data, const PatternOptions& options) {
+        return Delete(pattern.c_str(), pattern.size(), data, options);
+    }
+
+    // literal engines treat every pattern as a plain string, any other option isn't supported by default
+    virtual bool Insert(char const * pattern, size_t len, const DataT& data, const PatternOptions& options) {
+        return (options.flags & ~PatternOptions::kLiteral) == 0 && Insert(pattern, len, data);
+    }
+
+    virtual bool Delete(char const * pattern, size_t len, const DataT& data, const PatternOptions& options) {
+        return (options.flags & ~PatternOptions::kLiteral) == 0 && Delete(pattern, len, data);
+    }
+
+    // segments are searched as one contiguous text, so matches may cross segment boundaries;
+    // engines which can't carry their state from one segment to another use this copying version
+    virtual std::set<DataT> Find(const TextSegment * segments, size_t count) const {
+        size_t len = 0;
+        for (size_t i = 0; i < count; ++i) {
+            len += segments[i].len;
+        }
+
+        std::string text;
+        text.reserve(len);
+        for (size_t i = 0; i < count; ++i) {
+            text.append(segments[i].data, segments[i].len);
+        }
+
+        return Find(text.c_str(), text.size());
+    }
+
     virtual bool Insert(char const * pattern, size_t len, const DataT& data) = 0;
     virtual bool Delete(char const * pattern, size_t len, const DataT& data) = 0;
     virtual std::set<DataT> Find(char const * text, size_t len) const = 0;
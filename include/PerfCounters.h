@@ -0,0 +1,124 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#  include <unistd.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <linux/perf_event.h>
+#endif
+
+namespace StringAlgos {
+
+// Hardware counters of the calling thread around a scan, they are read by perf_event_open:
+//     PerfCounters counters;
+//     counters.Start();
+//     ps.Find(text);
+//     counters.Stop();
+// Valid() is false without a PMU (e.g. in a VM), when perf_event_paranoid forbids it or not on linux,
+// the counts are zeros then. Start/Stop may be called many times, the counts are of the last interval.
+class PerfCounters {
+public:
+    enum Event {
+        kCacheMisses,
+        kBranchMisses,
+        kEvents,
+    };
+
+    PerfCounters() {
+        for (int i = 0; i < kEvents; ++i) {
+            _fd[i] = -1;
+            _count[i] = 0;
+        }
+
+#ifdef __linux__
+        const uint64_t configs[kEvents] = {PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+        for (int i = 0; i < kEvents; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            _fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int i = 0; i < kEvents; ++i) {
+            if (_fd[i] >= 0) {
+                close(_fd[i]);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool Valid() const {
+        for (int i = 0; i < kEvents; ++i) {
+            if (_fd[i] < 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void Start() {
+#ifdef __linux__
+        for (int i = 0; i < kEvents; ++i) {
+            if (_fd[i] >= 0) {
+                ioctl(_fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void Stop() {
+#ifdef __linux__
+        for (int i = 0; i < kEvents; ++i) {
+            _count[i] = 0;
+            if (_fd[i] >= 0) {
+                ioctl(_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+                uint64_t value;
+                if (read(_fd[i], &value, sizeof(value)) == sizeof(value)) {
+                    _count[i] = value;
+                }
+            }
+        }
+#endif
+    }
+
+    uint64_t Count(Event event) const {
+        return _count[event];
+    }
+
+    uint64_t CacheMisses() const {
+        return Count(kCacheMisses);
+    }
+
+    uint64_t BranchMisses() const {
+        return Count(kBranchMisses);
+    }
+
+private:
+    int _fd[kEvents];
+    uint64_t _count[kEvents];
+};
+
+} // StringAlgos
+
+#endif // PERFCOUNTERS_H
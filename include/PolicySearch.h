@@ -0,0 +1,66 @@
+#ifndef POLICYSEARCH_H
+#define POLICYSEARCH_H
+
+#include <set>
+
+#include "PatternSearch.h"
+#include "SearchPolicies.h"
+
+namespace StringAlgos {
+
+// The virtual interface of PatternSearch on top of a policy based engine like FlatAho:
+// `Find` scans the text into SetSink, which stops when all the distinct data of the engine are found.
+// Hot code should call `Engine().Scan` with its own sink instead.
+template <typename EngineT>
+class PolicySearch : public PatternSearch<typename EngineT::Data>
+{
+    typedef typename EngineT::Data DataT;
+
+public:
+    using PatternSearch<DataT>::Insert;
+    using PatternSearch<DataT>::Delete;
+    using PatternSearch<DataT>::Find;
+
+    void Build() override {
+        _engine.Build();
+    }
+
+    size_t Size() const override {
+        return _engine.Size();
+    }
+
+    MemoryStats MemoryUsage() const override {
+        return _engine.MemoryUsage();
+    }
+
+    bool Insert(const char * pattern, size_t len, const DataT& data) override {
+        return _engine.Insert(pattern, len, data);
+    }
+
+    bool Delete(const char * pattern, size_t len, const DataT& data) override {
+        return _engine.Delete(pattern, len, data);
+    }
+
+    std::set<DataT> Find(const char * text, size_t len) const override {
+        SetSink<DataT> sink(_engine.Distinct());
+        _engine.Scan(text, len, sink);
+        return std::move(sink.Result());
+    }
+
+    std::set<DataT> Find(const TextSegment * segments, size_t count) const override {
+        SetSink<DataT> sink(_engine.Distinct());
+        _engine.Scan(segments, count, sink);
+        return std::move(sink.Result());
+    }
+
+    const EngineT& Engine() const {
+        return _engine;
+    }
+
+private:
+    EngineT _engine;
+};
+
+} // StringAlgos
+
+#endif // POLICYSEARCH_H
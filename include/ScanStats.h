@@ -0,0 +1,151 @@
+#ifndef SCANSTATS_H
+#define SCANSTATS_H
+
+#include <set>
+#include <mutex>
+#include <cstdint>
+
+namespace StringAlgos {
+
+// Counters of the scan loops of Aho, TrieSearch and Hyperscan. They are compiled in only with SCAN_STATS
+// defined (SCAN_STATS=y cmake ...), otherwise SCAN_STAT(...) is empty and the loops are the same as without them.
+// A scan counts into its local ScanStats and adds them to the counters of its thread at the end.
+struct ScanStats {
+    ScanStats()
+        : scans(0)
+        , bytes(0)
+        , rootBytes(0)
+        , linkSteps(0)
+        , outputLinks(0)
+        , matches(0)
+        , earlyExits(0)
+    {}
+
+    ScanStats& operator+=(const ScanStats& other) {
+        scans += other.scans;
+        bytes += other.bytes;
+        rootBytes += other.rootBytes;
+        linkSteps += other.linkSteps;
+        outputLinks += other.outputLinks;
+        matches += other.matches;
+        earlyExits += other.earlyExits;
+        return *this;
+    }
+
+    uint64_t scans;       // Find calls
+    uint64_t bytes;       // bytes passed by the scan loops
+    uint64_t rootBytes;   // bytes after which Aho is in the root, walks of TrieSearch stopped at the first byte
+    uint64_t linkSteps;   // failure transitions of Aho (the state doesn't get deeper), bytes re-read by the walks of TrieSearch
+    uint64_t outputLinks; // states of Aho which report the outputs of their output links
+    uint64_t matches;     // reported data of the states, hyperscan callbacks
+    uint64_t earlyExits;  // scans stopped since all data are found
+};
+
+#ifdef SCAN_STATS
+#  define SCAN_STAT(statement) statement
+#else
+#  define SCAN_STAT(statement)
+#endif
+
+// The counters of every thread are kept until the thread exits, then they are added to the retired ones,
+// so the total is the same before and after the exit.
+class ScanStatsRegistry {
+public:
+    class Slot {
+    public:
+        Slot() {
+            Instance().Register(this);
+        }
+
+        ~Slot() {
+            Instance().Retire(this);
+        }
+
+        void Add(const ScanStats& stats) {
+            std::lock_guard<std::mutex> lock(_m);
+            _stats += stats;
+        }
+
+        ScanStats Get() const {
+            std::lock_guard<std::mutex> lock(_m);
+            return _stats;
+        }
+
+        void Reset() {
+            std::lock_guard<std::mutex> lock(_m);
+            _stats = ScanStats();
+        }
+
+    private:
+        mutable std::mutex _m;
+        ScanStats _stats;
+    };
+
+    static ScanStatsRegistry& Instance() {
+        static ScanStatsRegistry registry;
+        return registry;
+    }
+
+    static Slot& Local() {
+        static thread_local Slot slot;
+        return slot;
+    }
+
+    ScanStats Total() const {
+        std::lock_guard<std::mutex> lock(_m);
+        ScanStats res = _retired;
+        for (const Slot * slot: _slots) {
+            res += slot->Get();
+        }
+
+        return res;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(_m);
+        _retired = ScanStats();
+        for (Slot * slot: _slots) {
+            slot->Reset();
+        }
+    }
+
+private:
+    void Register(Slot * slot) {
+        std::lock_guard<std::mutex> lock(_m);
+        _slots.insert(slot);
+    }
+
+    void Retire(Slot * slot) {
+        std::lock_guard<std::mutex> lock(_m);
+        _retired += slot->Get();
+        _slots.erase(slot);
+    }
+
+private:
+    mutable std::mutex _m;
+    std::set<Slot *> _slots;
+    ScanStats _retired;
+};
+
+// the counters of a finished scan are added to the ones of the calling thread
+inline void AddScanStats(const ScanStats& stats) {
+    ScanStatsRegistry::Local().Add(stats);
+}
+
+// the counters of the calling thread
+inline ScanStats ThreadScanStats() {
+    return ScanStatsRegistry::Local().Get();
+}
+
+// the sum of the counters of all threads, the exited ones too
+inline ScanStats TotalScanStats() {
+    return ScanStatsRegistry::Instance().Total();
+}
+
+inline void ResetScanStats() {
+    ScanStatsRegistry::Instance().Reset();
+}
+
+} // StringAlgos
+
+#endif // SCANSTATS_H
@@ -0,0 +1,178 @@
+#ifndef SEARCHPOLICIES_H
+#define SEARCHPOLICIES_H
+
+#include <set>
+#include <bitset>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "PatternSearch.h"
+#include "CaseFolding.h"
+
+namespace StringAlgos {
+
+// Alphabet policies map a byte of a pattern or of the text to a column of the transition table.
+// `Build` gets all patterns before the automaton is built, `Size` is the number of columns.
+
+// bytes as is
+struct ByteAlphabet {
+    void Build(const std::vector<std::string>&) {}
+
+    size_t Size() const {
+        return 256;
+    }
+
+    uchar_t Map(uchar_t c) const {
+        return c;
+    }
+};
+
+// ascii letters are case insensitive
+struct AsciiCaselessAlphabet {
+    void Build(const std::vector<std::string>&) {}
+
+    size_t Size() const {
+        return 256;
+    }
+
+    uchar_t Map(uchar_t c) const {
+        return AsciiFold(c);
+    }
+};
+
+// Every byte of the patterns gets its own column, all other bytes share the column 0,
+// so the rows of the table are as narrow as the alphabet of the dictionary. `FoldT` maps the bytes first.
+template <typename FoldT = ByteAlphabet>
+class CompactAlphabet {
+public:
+    CompactAlphabet()
+        : _size(1)
+    {
+        memset(_code, 0, sizeof(_code));
+    }
+
+    void Build(const std::vector<std::string>& patterns) {
+        bool used[256] = {};
+        for (const std::string& p: patterns) {
+            for (char c: p) {
+                used[_fold.Map(c)] = true;
+            }
+        }
+
+        _size = 1;
+        for (int c = 0; c < 256; ++c) {
+            _code[c] = 0;
+        }
+        for (int c = 0; c < 256; ++c) {
+            if (used[c]) {
+                _code[c] = _size++;
+            }
+        }
+        for (int c = 0; c < 256; ++c) {
+            _code[c] = _code[_fold.Map(c)];
+        }
+    }
+
+    size_t Size() const {
+        return _size;
+    }
+
+    unsigned Map(uchar_t c) const {
+        return _code[c];
+    }
+
+private:
+    FoldT _fold;
+    uint16_t _code[256];
+    size_t _size;
+};
+
+// Sinks get `(data, end)` of every match, `end` is the offset right after it; a sink returns true to stop the scan.
+
+// the distinct found data, the scan is stopped when all `expected` data are found
+template <typename DataT>
+class SetSink {
+public:
+    explicit SetSink(size_t expected)
+        : _expected(expected)
+    {}
+
+    bool operator()(const DataT& data, size_t) {
+        _res.insert(data);
+        return _res.size() == _expected;
+    }
+
+    std::set<DataT>& Result() {
+        return _res;
+    }
+
+private:
+    std::set<DataT> _res;
+    size_t _expected;
+};
+
+// data are indices less than `N`
+template <size_t N>
+class BitsetSink {
+public:
+    template <typename DataT>
+    bool operator()(const DataT& data, size_t) {
+        _res.set(data);
+        return false;
+    }
+
+    const std::bitset<N>& Result() const {
+        return _res;
+    }
+
+private:
+    std::bitset<N> _res;
+};
+
+// number of matches, every occurrence is counted
+class CountSink {
+public:
+    CountSink()
+        : _count(0)
+    {}
+
+    template <typename DataT>
+    bool operator()(const DataT&, size_t) {
+        ++_count;
+        return false;
+    }
+
+    size_t Result() const {
+        return _count;
+    }
+
+private:
+    size_t _count;
+};
+
+// `callback(data, end)` returns true to stop the scan
+template <typename CallbackT>
+class CallbackSink {
+public:
+    explicit CallbackSink(CallbackT callback)
+        : _callback(callback)
+    {}
+
+    template <typename DataT>
+    bool operator()(const DataT& data, size_t end) {
+        return _callback(data, end);
+    }
+
+private:
+    CallbackT _callback;
+};
+
+template <typename CallbackT>
+CallbackSink<CallbackT> MakeCallbackSink(CallbackT callback) {
+    return CallbackSink<CallbackT>(callback);
+}
+
+} // StringAlgos
+
+#endif // SEARCHPOLICIES_H
@@ -0,0 +1,189 @@
+#ifndef STATICAHO_H
+#define STATICAHO_H
+
+#include <set>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <initializer_list>
+
+#include "PatternSearch.h"
+
+namespace StringAlgos {
+
+// a pattern of the compile time automaton, it's made from a string literal
+struct StaticPattern {
+    template <size_t N>
+    constexpr StaticPattern(const char (&s)[N])
+        : data(s)
+        , len(N - 1)
+    {}
+
+    const char * data;
+    size_t len;
+};
+
+// Aho-Corasick automaton for a fixed set of patterns which is built by the compiler:
+// constexpr object has the transitions of all states by all characters as constant data,
+// so there is no Build at startup, and `Find` isn't virtual and is inlined into the caller.
+// Data of a pattern is its index in the list, empty patterns are never found.
+// `kMaxStates` is the sum of the lengths of the patterns + 1, see MakeStaticAho.
+template <size_t kPatterns, size_t kMaxStates>
+class StaticAho {
+public:
+    // the smallest type for the index of a state
+    typedef typename std::conditional<(kMaxStates <= (1u << 8)), uint8_t,
+            typename std::conditional<(kMaxStates <= (1u << 16)), uint16_t, uint32_t>::type>::type State;
+
+    static const int kAlphabetSize = 256;
+    static const size_t kWords = (kPatterns + 63) / 64;
+
+    constexpr explicit StaticAho(std::initializer_list<StaticPattern> patterns)
+        : _next{}
+        , _link{}
+        , _out{}
+        , _terminal{}
+        , _states(1)
+    {
+        size_t index = 0;
+        for (const StaticPattern& p: patterns) {
+            AddPattern(p, index++);
+        }
+
+        BuildLinks();
+    }
+
+    constexpr size_t Size() const {
+        return kPatterns;
+    }
+
+    constexpr size_t States() const {
+        return _states;
+    }
+
+    constexpr State Next(State s, uchar_t c) const {
+        return _next[s][c];
+    }
+
+    // calls `onMatch(index, end)` for every pattern which ends at the offset `end` of the text
+    template <typename OnMatchT>
+    void Scan(const char * text, size_t len, OnMatchT onMatch) const {
+        const uchar_t * first = (const uchar_t *) text;
+        State s = 0;
+
+        for (size_t i = 0; i < len; ++i) {
+            s = _next[s][first[i]];
+
+            if (_terminal[s]) {
+                for (size_t w = 0; w < kWords; ++w) {
+                    for (uint64_t bits = _out[s][w]; bits; bits &= bits - 1) {
+                        onMatch(w * 64 + __builtin_ctzll(bits), i + 1);
+                    }
+                }
+            }
+        }
+    }
+
+    // the found patterns are marked in the bitmask, so the scan loop doesn't touch the set
+    std::set<size_t> Find(const char * text, size_t len) const {
+        uint64_t found[kWords] = {};
+        Scan(text, len, [&found](size_t index, size_t) {
+            found[index / 64] |= uint64_t(1) << (index % 64);
+        });
+
+        std::set<size_t> res;
+        for (size_t w = 0; w < kWords; ++w) {
+            for (uint64_t bits = found[w]; bits; bits &= bits - 1) {
+                res.insert(w * 64 + __builtin_ctzll(bits));
+            }
+        }
+
+        return res;
+    }
+
+    std::set<size_t> Find(const std::string& text) const {
+        return Find(text.data(), text.size());
+    }
+
+private:
+    constexpr void AddPattern(const StaticPattern& p, size_t index) {
+        if (p.len == 0) {
+            return;
+        }
+
+        State s = 0;
+        for (size_t i = 0; i < p.len; ++i) {
+            uchar_t c = p.data[i];
+
+            // trie edges never lead to the root
+            if (!_next[s][c]) {
+                _next[s][c] = _states++;
+            }
+            s = _next[s][c];
+        }
+
+        _out[s][index / 64] |= uint64_t(1) << (index % 64);
+        _terminal[s] = true;
+    }
+
+    // bfs, the missing transitions of a state are the ones of its failure link which is shallower
+    constexpr void BuildLinks() {
+        State queue[kMaxStates] = {};
+        size_t head = 0, tail = 0;
+
+        for (int c = 0; c < kAlphabetSize; ++c) {
+            if (_next[0][c]) {
+                queue[tail++] = _next[0][c];
+            }
+        }
+
+        while (head != tail) {
+            State u = queue[head++];
+
+            for (int c = 0; c < kAlphabetSize; ++c) {
+                State v = _next[u][c];
+                State linkNext = _next[_link[u]][c];
+
+                if (!v) {
+                    _next[u][c] = linkNext;
+                    continue;
+                }
+
+                _link[v] = linkNext;
+                for (size_t w = 0; w < kWords; ++w) {
+                    _out[v][w] |= _out[linkNext][w];
+                }
+                _terminal[v] = _terminal[v] || _terminal[linkNext];
+
+                queue[tail++] = v;
+            }
+        }
+    }
+
+private:
+    State _next[kMaxStates][kAlphabetSize];
+    State _link[kMaxStates];
+    uint64_t _out[kMaxStates][kWords];
+    bool _terminal[kMaxStates];
+    size_t _states;
+};
+
+constexpr size_t StaticStates(std::initializer_list<size_t> lens) {
+    size_t res = 1;
+    for (size_t len: lens) {
+        res += len;
+    }
+
+    return res;
+}
+
+// constexpr auto kMethods = MakeStaticAho("GET", "POST", "HEAD");
+template <size_t... N>
+constexpr StaticAho<sizeof...(N), StaticStates({(N - 1)...})> MakeStaticAho(const char (&... patterns)[N]) {
+    return StaticAho<sizeof...(N), StaticStates({(N - 1)...})>({StaticPattern(patterns)...});
+}
+
+} // StringAlgos
+
+#endif // STATICAHO_H
@@ -5,14 +5,31 @@
 #include <cstring>
 #include <cstdint>
 #include <cassert>
+#include <algorithm>
 
 #include "PatternSearch.h"
+#include "CaseFolding.h"
+#include "ScanStats.h"
 
 namespace StringAlgos {
 
+// Patterns with kCaseless switch the trie to the folded case like in Aho:
+// an upper case edge is the same vertex as the lower case one, case sensitive patterns with letters are checked.
+// Patterns with kAnchoredStart are kept in the separate trie which is walked only from the beginning of the text.
+// Only the first `maxKeyLen` bytes of a pattern are kept in the trie, the rest of a longer pattern is checked.
 template <typename DataT>
 class TrieSearch : public PatternSearch<DataT>
 {
+    // output which is reported only if the matched text is the same as the pattern and is placed right
+    struct CheckedOutput {
+        DataT data;
+        PatternOptions options;
+        std::string pattern;
+        size_t tail;          // bytes of the pattern after its key in the trie
+        uint64_t fingerprint; // of the tail
+        uint32_t id;          // of the data, see DataIds
+    };
+
     struct TrieVertex {
         static const int kAlphabetSize = 256; // 128? - ~utf
 
@@ -23,9 +40,10 @@ class TrieSearch : public PatternSearch<DataT>
             memset(child, 0, sizeof(child));
         }
 
+        // upper case edges of the folded trie are aliases of the lower case ones
         ~TrieVertex() {
             for (int i = 0; i < kAlphabetSize; ++i) {
-                if (child[i])
+                if (child[i] && (i == AsciiFold(i) || child[i] != child[AsciiFold(i)]))
                     delete child[i];
             }
         }
@@ -34,7 +52,8 @@ class TrieSearch : public PatternSearch<DataT>
         size_t  cntChilds;
         bool terminal;
 
-        std::vector<DataT> data;
+        std::vector<uint32_t> ids; // of the data
+        std::vector<CheckedOutput> checked;
     };
 
 public:
@@ -42,30 +61,64 @@ public:
     using PatternSearch<DataT>::Delete;
     using PatternSearch<DataT>::Find;
 
-    TrieSearch()
+    // `defaults` are the options of the patterns inserted without options,
+    // `maxKeyLen` is the maximal depth of the trie
+    explicit TrieSearch(const PatternOptions& defaults = PatternOptions(), size_t maxKeyLen = SIZE_MAX)
         : _root(new TrieVertex)
+        , _anchoredRoot(new TrieVertex)
+        , _folded(false)
+        , _defaults(defaults)
+        , _maxKeyLen(std::max<size_t>(1, maxKeyLen))
     {}
 
     ~TrieSearch() {
         delete _root;
+        delete _anchoredRoot;
     }
 
     size_t Size() const override {
-        return _root->cntChilds;
+        return _root->cntChilds + _anchoredRoot->cntChilds;
+    }
+
+    MemoryStats MemoryUsage() const override {
+        MemoryStats res;
+        Count(_root, res);
+        Count(_anchoredRoot, res);
+        res.outputs += _ids.MemoryUsage();
+        return res;
     }
 
     bool Insert(const char * pattern, size_t len, const DataT& data) override {
+        return Insert(pattern, len, data, _defaults);
+    }
+
+    bool Delete(const char * pattern, size_t len, const DataT& data) override {
+        return Delete(pattern, len, data, _defaults);
+    }
+
+    bool Insert(const char * pattern, size_t len, const DataT& data, const PatternOptions& patternOptions) override {
+        PatternOptions options;
+        if (!Canonical(pattern, len, patternOptions, options)) {
+            return false;
+        }
+
+        if (options.Has(PatternOptions::kCaseless) && !_folded) {
+            Fold();
+        }
+
         const uchar_t * first = (const uchar_t *) pattern;
-        const uchar_t * last = first + len;
+        const uchar_t * last = first + std::min(len, _maxKeyLen);
+        bool checked = IsChecked(pattern, len, options);
 
-        TrieVertex * curVer = _root;
+        TrieVertex * root = RootOf(options);
+        TrieVertex * curVer = root;
 
         for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
-            uchar_t c = *ptr;
+            uchar_t c = KeyChar(*ptr);
 
             curVer->cntChilds++;
             if (!(curVer->child[c])) {
-                curVer->child[c] = new TrieVertex;
+                SetChild(curVer, c, new TrieVertex);
             }
 
             curVer = curVer->child[c];
@@ -76,43 +129,54 @@ public:
 
         // assert that pair <pattern, data> is unique in the dictionary
         {
-            for (DataT& d: curVer->data) {
-                if (d == data) {
-                    curVer = _root;
+            if (FindOutput(curVer, pattern, len, data, options, checked)) {
+                curVer = root;
 
-                    for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
-                        uchar_t c = *ptr;
+                for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
+                    uchar_t c = KeyChar(*ptr);
 
-                        assert (curVer);
-                        curVer->cntChilds--;
-                        curVer = curVer->child[c];
-                    }
+                    assert (curVer);
                     curVer->cntChilds--;
-
-                    return false;
+                    curVer = curVer->child[c];
                 }
+                curVer->cntChilds--;
+
+                return false;
             }
         }
 
-        curVer->data.push_back(data);
+        uint32_t id = _ids.Acquire(data);
+        if (checked) {
+            size_t tail = len - (last - first);
+            curVer->checked.push_back(CheckedOutput{data, options, std::string(pattern, len), tail, Fingerprint(pattern + len - tail, tail), id});
+        } else {
+            curVer->ids.push_back(id);
+        }
 
         return true;
     }
 
-    bool Delete(const char * pattern, size_t len, const DataT& data) override {
+    bool Delete(const char * pattern, size_t len, const DataT& data, const PatternOptions& patternOptions) override {
+        PatternOptions options;
+        if (!Canonical(pattern, len, patternOptions, options)) {
+            return false;
+        }
+
         const uchar_t * first = (const uchar_t *) pattern;
-        const uchar_t * last = first + len;
+        const uchar_t * last = first + std::min(len, _maxKeyLen);
+        bool checked = IsChecked(pattern, len, options);
 
-        TrieVertex * curVer = _root;
+        TrieVertex * root = RootOf(options);
+        TrieVertex * curVer = root;
 
         // assert that `pattern` was added earlier to the dict
         {
-            if (len == 0) {
+            if (len == 0 || (options.Has(PatternOptions::kCaseless) && !_folded)) {
                 return false;
             }
 
             for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
-                uchar_t c = *ptr;
+                uchar_t c = KeyChar(*ptr);
                 curVer = curVer->child[c];
 
                 if (!curVer) {
@@ -120,27 +184,23 @@ public:
                 }
             }
 
-            bool found = false;
-            for (DataT& d: curVer->data) {
-                if (d == data) {
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) {
+            if (!FindOutput(curVer, pattern, len, data, options, checked)) {
                 return false;
             }
         }
 
-        curVer = _root;
-        for (uchar_ptr_t ptr = first; ptr + 1 != last; ++ptr) {
-            uchar_t c = *ptr;
+        EraseOutput(curVer, pattern, len, data, options, checked);
+        _ids.Release(data);
+
+        // the subtree is deleted when the pattern is the last one in it
+        curVer = root;
+        for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
+            uchar_t c = KeyChar(*ptr);
 
             curVer->cntChilds--;
             if (curVer->child[c]->cntChilds == 1) {
                 delete curVer->child[c];
-                curVer->child[c] = nullptr;
+                SetChild(curVer, c, nullptr);
                 curVer = nullptr;
 
                 break;
@@ -150,65 +210,258 @@ public:
         }
 
         if (curVer) {
-            uchar_t c = *(last - 1);
+            curVer->cntChilds--;
+            curVer->terminal = !curVer->ids.empty() || !curVer->checked.empty();
+        }
 
-            assert(len == 1 || curVer->cntChilds > 1);
-            assert(curVer->child[c]->terminal && curVer->child[c]->data.size());
+        return true;
+    }
 
-            curVer->cntChilds--;
+    std::set<DataT> Find(const char *text, size_t len) const override {
+        TextSegment segment{text, len};
+        return Find(&segment, 1);
+    }
 
-            if (curVer->child[c]->cntChilds == 1) {
-                delete curVer->child[c];
-                curVer->child[c] = nullptr;
-            } else {
-                curVer = curVer->child[c];
-                for (auto it = curVer->data.begin(); it != curVer->data.end(); ++it) {
-                    if (*it == data) {
-                        curVer->data.erase(it);
-                        break;
-                    }
-                }
+    // a walk from the start position continues to the next segments
+    std::set<DataT> Find(const TextSegment * segments, size_t count) const override {
+        FoundIds res(_ids.Bound());
+        ScanStats stats;
+        if (Walks(segments, count, res, stats)) {
+            SCAN_STAT(++stats.earlyExits);
+        }
 
-                if (curVer->data.empty()) {
-                    curVer->terminal = false;
-                }
+        SCAN_STAT(++stats.scans; AddScanStats(stats));
+        return res.Data(_ids);
+    }
 
-                curVer->cntChilds--;
+private:
+    // returns true if all data are found
+    bool Walks(const TextSegment * segments, size_t count, FoundIds& res, ScanStats& stats) const {
+        TextView text(segments, count);
+        size_t offset = 0;
+
+        if (_anchoredRoot->cntChilds && Walk(_anchoredRoot, segments, count, 0, 0, 0, text, res, stats)) {
+            return true;
+        }
+
+        for (size_t i = 0; i < count; offset += segments[i].len, ++i) {
+            for (size_t start = 0; start < segments[i].len; ++start) {
+                SCAN_STAT(++stats.bytes);
+                if (Walk(_root, segments, count, i, start, offset, text, res, stats)) {
+                    return true;
+                }
             }
         }
 
+        return false;
+    }
+
+    // kLiteral means nothing for the literal search, kCaseless - for a pattern without letters
+    static bool Canonical(const char * pattern, size_t len, const PatternOptions& options, PatternOptions& res) {
+        const unsigned supported = PatternOptions::kLiteral | PatternOptions::kCaseless | PatternOptions::kAnchoredStart |
+                                   PatternOptions::kAnchoredEnd | PatternOptions::kWordBoundary;
+        if (options.flags & ~supported) {
+            return false;
+        }
+
+        res = options;
+        res.flags &= ~PatternOptions::kLiteral;
+        if (!HasAsciiLetters(pattern, len)) {
+            res.flags &= ~PatternOptions::kCaseless;
+        }
+
         return true;
     }
 
-    std::set<DataT> Find(const char *text, size_t len) const override {
-        const uchar_t * first = (const uchar_t *) text;
-        const uchar_t * last = first + len;
+    // the walk starts at `start` of the segment `i`, `offset` is the offset of this segment in the text;
+    // returns true if all data are found
+    bool Walk(TrieVertex * curVer, const TextSegment * segments, size_t count, size_t i, size_t start, size_t offset,
+              const TextView& text, FoundIds& res, ScanStats& stats) const {
+        (void) stats; // it's counted only with SCAN_STATS
+        size_t end = offset + start;
 
-        std::set<DataT> res;
-        for (size_t i = 0; i < len; ++i) {
-            TrieVertex * curVer = _root;
+        for (size_t j = i; j < count; ++j) {
+            const uchar_t * first = (const uchar_t *) segments[j].data + (j == i ? start : 0);
+            const uchar_t * last = (const uchar_t *) segments[j].data + segments[j].len;
 
-            for (uchar_ptr_t ptr = first + i; ptr != last; ++ptr) {
+            for (uchar_ptr_t ptr = first; ptr != last; ++ptr) {
                 uchar_t c = *ptr;
 
                 curVer = curVer->child[c];
-                if (!curVer) break;
+                if (!curVer) {
+                    SCAN_STAT(stats.rootBytes += end == offset + start);
+                    return false;
+                }
+                SCAN_STAT(stats.linkSteps += end != offset + start);
+                ++end;
 
                 if (curVer->terminal) {
-                    res.insert(curVer->data.begin(), curVer->data.end());
+                    res.Add(curVer->ids);
+                    SCAN_STAT(stats.matches += curVer->ids.size());
+
+                    for (const CheckedOutput& out: curVer->checked) {
+                        if (Check(out, text, offset + start, end)) {
+                            res.Add(out.id);
+                        }
+                    }
 
-                    if (res.size() == Size()) {
-                        break;
+                    if (res.Count() == _ids.Size()) {
+                        return true;
                     }
                 }
             }
         }
 
-        return res;
+        return false;
+    }
+
+    // `end` is the offset right after the match of the key, the tail of the pattern follows it
+    static bool Check(const CheckedOutput& out, const TextView& text, size_t begin, size_t end) {
+        end += out.tail;
+        if (end > text.Size()) {
+            return false;
+        }
+
+        const std::string& p = out.pattern;
+        if (!out.options.Has(PatternOptions::kCaseless)) {
+            if ((out.tail && Fingerprint(text, end - out.tail, out.tail) != out.fingerprint) || !text.Equals(begin, p.data(), p.size())) {
+                return false;
+            }
+        } else if (out.tail && !EqualsAsciiCaseless(text, begin, p.data(), p.size())) {
+            return false;
+        }
+
+        return IsPlaced(out.options, text, begin, end);
+    }
+
+    uchar_t KeyChar(uchar_t c) const {
+        return _folded ? AsciiFold(c) : c;
+    }
+
+    bool IsChecked(const char * pattern, size_t len, const PatternOptions& options) const {
+        return options.Has(PatternOptions::kAnchoredEnd) || options.Has(PatternOptions::kWordBoundary) || len > _maxKeyLen ||
+               (_folded && !options.Has(PatternOptions::kCaseless) && HasAsciiLetters(pattern, len));
+    }
+
+    TrieVertex * RootOf(const PatternOptions& options) const {
+        return options.Has(PatternOptions::kAnchoredStart) ? _anchoredRoot : _root;
+    }
+
+    // `c` is a key character, so it's a lower case letter in the folded trie
+    void SetChild(TrieVertex * v, uchar_t c, TrieVertex * child) {
+        v->child[c] = child;
+        if (_folded && IsAsciiLetter(c)) {
+            v->child[c - ('a' - 'A')] = child;
+        }
+    }
+
+    // a caseless pattern is the same rule in any case like in the folded trie, kUtf8 isn't supported here
+    static bool SameOutput(const CheckedOutput& out, const char * pattern, size_t len, const DataT& data, const PatternOptions& options) {
+        if (out.data != data || !(out.options == options) || out.pattern.size() != len) {
+            return false;
+        }
+
+        if (!options.Has(PatternOptions::kCaseless)) {
+            return memcmp(out.pattern.data(), pattern, len) == 0;
+        }
+
+        return AsciiFold(out.pattern.data(), len) == AsciiFold(pattern, len);
+    }
+
+    bool FindOutput(TrieVertex * v, const char * pattern, size_t len, const DataT& data, const PatternOptions& options, bool checked) const {
+        if (checked) {
+            for (const CheckedOutput& out: v->checked) {
+                if (SameOutput(out, pattern, len, data, options)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        uint32_t id = 0;
+        return _ids.Find(data, id) && std::find(v->ids.begin(), v->ids.end(), id) != v->ids.end();
+    }
+
+    void EraseOutput(TrieVertex * v, const char * pattern, size_t len, const DataT& data, const PatternOptions& options, bool checked) const {
+        if (checked) {
+            for (auto it = v->checked.begin(); it != v->checked.end(); ++it) {
+                if (SameOutput(*it, pattern, len, data, options)) {
+                    v->checked.erase(it);
+                    break;
+                }
+            }
+        } else {
+            // FindOutput has found the output
+            uint32_t id = 0;
+            bool found = _ids.Find(data, id);
+            assert(found);
+            (void) found;
+            v->ids.erase(std::find(v->ids.begin(), v->ids.end(), id));
+        }
+    }
+
+    // all patterns are inserted again into the folded trie
+    void Fold() {
+        std::vector<CheckedOutput> patterns;
+        std::string path;
+        Collect(_root, PatternOptions(), path, patterns);
+        Collect(_anchoredRoot, PatternOptions(PatternOptions::kAnchoredStart), path, patterns);
+
+        delete _root;
+        delete _anchoredRoot;
+        _root = new TrieVertex;
+        _anchoredRoot = new TrieVertex;
+        _folded = true;
+
+        for (const CheckedOutput& p: patterns) {
+            _ids.Release(p.data);
+            Insert(p.pattern.data(), p.pattern.size(), p.data, p.options);
+        }
+    }
+
+    // the memory of the subtree, the aliases of the folded trie are skipped like in the destructor
+    static void Count(const TrieVertex * v, MemoryStats& res) {
+        res.states += sizeof(TrieVertex) - sizeof(v->child);
+        res.transitions += sizeof(v->child);
+        res.outputs += HeapBytes(v->ids) + HeapBytes(v->checked);
+
+        for (const CheckedOutput& out: v->checked) {
+            res.patterns += HeapBytes(out.pattern);
+        }
+
+        for (int i = 0; i < TrieVertex::kAlphabetSize; ++i) {
+            if (v->child[i] && (i == AsciiFold(i) || v->child[i] != v->child[AsciiFold(i)])) {
+                Count(v->child[i], res);
+            }
+        }
+    }
+
+    // the trie isn't folded yet, so the path to a vertex is the pattern of its data
+    void Collect(TrieVertex * v, const PatternOptions& options, std::string& path, std::vector<CheckedOutput>& patterns) const {
+        for (uint32_t id: v->ids) {
+            // the unchecked pattern is the whole key, it has no tail
+            patterns.push_back(CheckedOutput{_ids.Data(id), options, path, 0, Fingerprint(path.data() + path.size(), 0), id});
+        }
+        patterns.insert(patterns.end(), v->checked.begin(), v->checked.end());
+
+        for (int i = 0; i < TrieVertex::kAlphabetSize; ++i) {
+            if (v->child[i]) {
+                path.push_back(i);
+                Collect(v->child[i], options, path, patterns);
+                path.pop_back();
+            }
+        }
     }
 
 private:
     TrieVertex * _root;
+    TrieVertex * _anchoredRoot;
+    bool _folded;
+    PatternOptions _defaults;
+    size_t _maxKeyLen;
+
+    DataIds<DataT> _ids;
 };
 
 } // StringAlgos
@@ -4,6 +4,12 @@
 #include <TrieSearch.h>
 #include <Aho.h>
 #include <Hyperscan.h>
+#include <HybridSearch.h>
+#include <StaticAho.h>
+#include <FlatAho.h>
+#include <PolicySearch.h>
+#include <ScanStats.h>
+#include <PerfCounters.h>
 
 #ifdef BENCHMARK
 #  include <benchmarks.h>
@@ -20,10 +26,26 @@ int main(int argc, char **argv) {
 #ifdef BENCHMARK
     cerr << endl << "LinearSearch" << endl;
     startBM<LinearSearch>();
+    startUpdateBM<LinearSearch>();
     cerr << endl << "Hyperscan" << endl;
     startBM<Hyperscan>();
+    startUpdateBM<Hyperscan>();
+    startLiteralBM<Hyperscan>();
+    startShardsBM<Hyperscan>();
+    startDpiBM<Hyperscan>();
+    BM_MIXED<Hyperscan<int>>();
+    BM_SCAN_STATS<Hyperscan<int>>();
+    cerr << endl << "HybridSearch" << endl;
+    BM_MIXED<HybridSearch<int>>();
     cerr << endl << "Aho" << endl;
     startBM<Aho>();
+    startCaseBM<Aho>();
+    startLayoutBM<Aho>();
+    startLongBM<Aho>();
+    startDpiBM<Aho>();
+    BM_STATIC<Aho<int>>();
+    BM_POLICY<Aho<int>>();
+    BM_SCAN_STATS<Aho<int>>();
     cerr << endl << "TrieSearch" << endl;
     startBM<TrieSearch>();
 #endif
@@ -4,12 +4,22 @@
 #include <iostream>
 #include <ctime>
 #include <thread>
+#include <atomic>
 #include <map>
+#include <numeric>
+#include <chrono>
 
 #include <LinearSearch.h>
 #include <TrieSearch.h>
 #include <Aho.h>
 #include <Hyperscan.h>
+#include <HybridSearch.h>
+#include <StaticAho.h>
+#include <FlatAho.h>
+#include <PolicySearch.h>
+#include <ScanStats.h>
+#include <PerfCounters.h>
+#include <AhoRegex.h>
 
 #include <gtest/gtest.h>
 
@@ -18,6 +28,7 @@ namespace StringAlgos {
 
 template <typename DataT>
 struct HyperscanAddDotAll : public Hyperscan<DataT> {
+    using Hyperscan<DataT>::Hyperscan;
     using Hyperscan<DataT>::Find;
     using Hyperscan<DataT>::Insert;
     using Hyperscan<DataT>::Delete;
@@ -33,6 +44,85 @@ struct HyperscanAddDotAll : public Hyperscan<DataT> {
     }
 };
 
+template <typename DataT>
+struct HyperscanLiteral : public Hyperscan<DataT> {
+    HyperscanLiteral()
+        : Hyperscan<DataT>(PatternOptions(PatternOptions::kLiteral))
+    {}
+};
+
+template <typename DataT>
+struct HyperscanSharded : public HyperscanAddDotAll<DataT> {
+    HyperscanSharded()
+        : HyperscanAddDotAll<DataT>(PatternOptions(), 4)
+    {}
+};
+
+template <typename DataT>
+struct HyperscanVectored : public HyperscanAddDotAll<DataT> {
+    HyperscanVectored()
+        : HyperscanAddDotAll<DataT>(PatternOptions(), 1, HS_MODE_VECTORED)
+    {}
+};
+
+template <typename DataT>
+struct AhoLazy : public Aho<DataT> {
+    AhoLazy()
+        : Aho<DataT>(PatternOptions(), AhoLayout::Lazy())
+    {}
+};
+
+// only a few states have the cached transitions
+template <typename DataT>
+struct AhoLazySmallBudget : public Aho<DataT> {
+    AhoLazySmallBudget()
+        : Aho<DataT>(PatternOptions(), AhoLayout::Lazy(8 * Aho<DataT>::kRowSize))
+    {}
+};
+
+template <typename DataT>
+struct AhoSparse : public Aho<DataT> {
+    AhoSparse()
+        : Aho<DataT>(PatternOptions(), AhoLayout::Sparse())
+    {}
+};
+
+template <typename DataT>
+struct AhoHybrid : public Aho<DataT> {
+    AhoHybrid()
+        : Aho<DataT>(PatternOptions(), AhoLayout::Hybrid())
+    {}
+};
+
+// the block has a few rows, so the most states are sparse
+template <typename DataT>
+struct AhoHybridSmallBlock : public Aho<DataT> {
+    AhoHybridSmallBlock()
+        : Aho<DataT>(PatternOptions(), AhoLayout::Hybrid(2, 4 * Aho<DataT>::kRowSize))
+    {}
+};
+
+// patterns longer than 4 bytes are truncated
+template <typename DataT>
+struct AhoTruncated : public Aho<DataT> {
+    AhoTruncated()
+        : Aho<DataT>(PatternOptions(), AhoLayout::Dense(), 4)
+    {}
+};
+
+template <typename DataT>
+struct TrieSearchTruncated : public TrieSearch<DataT> {
+    TrieSearchTruncated()
+        : TrieSearch<DataT>(PatternOptions(), 4)
+    {}
+};
+
+template <typename DataT>
+struct FlatAhoSearch : public PolicySearch<FlatAho<DataT>> {};
+
+template <typename DataT>
+struct FlatAhoCompact16 : public PolicySearch<FlatAho<DataT, CompactAlphabet<>, uint16_t>> {};
+
 template <typename DataT>
 struct HyperscanWithEscapedCharacter : public Hyperscan<DataT> {
     using Hyperscan<DataT>::Find;
@@ -589,86 +679,1569 @@ void manualRegexEscapedTests() {
     checkManualRegexs(ps);
 }
 
-TEST (Hyperscan, ManualTests) {
-    manualTest<HyperscanAddDotAll>();
-}
+// text is split to random segments, result must be the same as for the whole text
+template<template <typename> class PatternSearchT, typename T = int>
+void vectoredTest(const int LEN_T = 1000, const int CNT_W = 100, const int LEN_W = 10, const int ALPH_SIZE = 4, const int CNT_TESTS = 100) {
+    for (int i = 0; i < CNT_TESTS; ++i) {
+        PatternSearchT<T> ps;
 
-TEST (Hyperscan, ManualRegexTests) {
-    manualRegexTests<Hyperscan>();
-}
+        const int cntWords = rand() % CNT_W + 1;
+        for (int j = 0; j < cntWords; ++j) {
+            string word(rand() % LEN_W + 1, 'a');
+            for (char& c: word) {
+                c = rand() % ALPH_SIZE + 'a';
+            }
 
-TEST (Hyperscan, ManualRegexEscapedTests) {
-    manualRegexEscapedTests<HyperscanWithEscapedCharacter>();
-}
+            ps.Insert(word, j);
+        }
+        ps.Build();
 
+        string text(rand() % LEN_T + 1, 'a');
+        for (char& c: text) {
+            c = rand() % ALPH_SIZE + 'a';
+        }
 
-TEST (Hyperscan, RandomTests) {
-    randomTest<HyperscanAddDotAll>(100);
-}
+        vector<TextSegment> segments;
+        for (size_t pos = 0; pos < text.size(); ) {
+            size_t len = std::min<size_t>(rand() % LEN_W, text.size() - pos);
+            segments.push_back(TextSegment{text.c_str() + pos, len});
+            pos += len;
+        }
 
-TEST (Hyperscan, SimpleMultiThreadingTest) {
-    SimpleMultiThreadingTest<HyperscanAddDotAll>();
+        ASSERT_EQ(ps.Find(segments.data(), segments.size()), ps.Find(text));
+    }
 }
 
-TEST (Hyperscan, manualSwmrThreadingTest) {
-    manualSwmrThreadingTest<HyperscanAddDotAll>();
-}
+// the footprint grows with the dictionary and goes back when the patterns are deleted
+template<template <typename> class PatternSearchT, typename T = int>
+MemoryStats memoryTest() {
+    PatternSearchT<T> ps;
+    ps.Build();
+    const size_t empty = ps.MemoryUsage().Total();
 
-TEST (Hyperscan, WorstCaseTest) {
-    WorstCaseTest<HyperscanAddDotAll>();
-}
+    vector<string> words;
+    for (int i = 0; i < 100; ++i) {
+        string word(rand() % 30 + 20, 'a');
+        for (char& c: word) {
+            c = rand() % 26 + 'a';
+        }
 
-TEST (Hyperscan, WorstCaseNotMatchTest) {
-    WorstCaseTest<HyperscanAddDotAll>(true);
-}
+        words.push_back(word);
+        EXPECT_TRUE(ps.Insert(word, i));
+    }
+    ps.Build();
 
-TEST (LinearSearch, ManualTests) {
-    manualTest<LinearSearch>();
+    MemoryStats full = ps.MemoryUsage();
+    EXPECT_GT(full.Total(), empty);
+    EXPECT_GT(full.patterns + full.transitions, 0);
+
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(ps.Delete(words[i], i));
+    }
+    ps.Build();
+
+    EXPECT_LT(ps.MemoryUsage().Total(), full.Total());
+    return full;
 }
 
-TEST (LinearSearch, WorstCaseTest) {
-    WorstCaseTest<LinearSearch>();
+// patterns with the same data: the data is found while any of them is in the dictionary
+template<template <typename> class PatternSearchT, typename T = int>
+void sharedDataTest() {
+    PatternSearchT<T> ps;
+    ASSERT_TRUE(ps.Insert("abc", 1));
+    ASSERT_TRUE(ps.Insert("xyz", 1));
+    ASSERT_TRUE(ps.Insert("zz", 1));
+    ASSERT_TRUE(ps.Insert("b", 2));
+    ps.Build();
+
+    ASSERT_EQ(ps.Size(), 4);
+    ASSERT_EQ(ps.Find("xyzabc"), std::set<T>({1, 2}));
+    ASSERT_EQ(ps.Find("--xyz"), std::set<T>({1}));
+
+    ASSERT_TRUE(ps.Delete("xyz", 1));
+    ASSERT_TRUE(ps.Delete("zz", 1));
+    ps.Build();
+
+    ASSERT_EQ(ps.Find("xyzz"), std::set<T>());
+    ASSERT_EQ(ps.Find("abc"), std::set<T>({1, 2}));
+
+    ASSERT_TRUE(ps.Delete("abc", 1));
+    ASSERT_TRUE(ps.Insert("xy", 3));
+    ps.Build();
+
+    ASSERT_EQ(ps.Find("abcxy"), std::set<T>({2, 3}));
 }
 
-// so hard for LinearSearch
-//TEST (LinearSearch, WorstCaseNotMatchTest) {
-//    WorstCaseTest<LinearSearch>(true);
-//}
+template<template <typename> class PatternSearchT, typename T = int>
+void lengthDelimitedTest() {
+    PatternSearchT<T> ps;
+    const char * text = "abcdef";
+
+    ASSERT_TRUE(ps.Insert(text, 3, 1));
+    ASSERT_TRUE(ps.Insert(text, 4, 1));
+    ASSERT_FALSE(ps.Insert("abc", 1));
+    ASSERT_TRUE(ps.Insert(text + 2, 2, 2));
+    ASSERT_TRUE(ps.Insert(text + 4, 2, 3));
+    ASSERT_EQ(ps.Size(), 4);
+
+    // deletion from the middle moves the last pattern, it must be still reachable
+    ASSERT_TRUE(ps.Delete("abc", 1));
+    ASSERT_FALSE(ps.Delete(text, 3, 1));
+    ASSERT_TRUE(ps.Delete(text + 4, 2, 3));
+    ASSERT_FALSE(ps.Delete("ef", 3));
+    ps.Build();
 
-TEST (Aho, ManualTests) {
-    manualTest<Aho>();
+    ASSERT_EQ(ps.Size(), 2);
+    std::set<int> res{1, 2};
+    ASSERT_EQ(ps.Find("xabcdefx"), res);
 }
 
-TEST (Aho, SimpleMultiThreadingTest) {
-    SimpleMultiThreadingTest<Aho>();
+template<template <typename> class PatternSearchT, typename T = int>
+void caselessTest() {
+    const PatternOptions caseless(PatternOptions::kCaseless);
+    PatternSearchT<T> ps;
+
+    ASSERT_TRUE(ps.Insert("Host", 1));
+    ASSERT_TRUE(ps.Insert("user-agent", 2, caseless));
+    ASSERT_TRUE(ps.Insert("HOST", 3, caseless));
+    ASSERT_FALSE(ps.Insert("host", 3, caseless));
+    ASSERT_TRUE(ps.Insert("host", 3));
+    ASSERT_TRUE(ps.Insert("1234", 4, caseless));
+    ASSERT_FALSE(ps.Insert("1234", 4));
+    ASSERT_TRUE(ps.Insert("GET", 5, PatternOptions(PatternOptions::kLiteral)));
+    ASSERT_EQ(ps.Size(), 6);
+    ps.Build();
+
+    {
+        std::set<T> res{2, 3, 4};
+        ASSERT_EQ(ps.Find("get / HTTP/1.1\r\nHOST: x\r\nUser-Agent: 1234"), res);
+    }
+
+    {
+        std::set<T> res{1, 3, 5};
+        ASSERT_EQ(ps.Find("GET Host"), res);
+    }
+
+    ASSERT_FALSE(ps.Delete("HOST", 1));
+    ASSERT_FALSE(ps.Delete("host", 2, caseless));
+    ASSERT_TRUE(ps.Delete("Host", 1));
+    ASSERT_TRUE(ps.Delete("HoSt", 3, caseless));
+    ASSERT_TRUE(ps.Delete("1234", 4));
+    ps.Build();
+
+    {
+        std::set<T> res{2, 3};
+        ASSERT_EQ(ps.Find("host USER-AGENT"), res);
+    }
+
+    // the caseless instance
+    PatternSearchT<T> ps2(caseless);
+    ASSERT_TRUE(ps2.Insert("Content-Type", 1));
+    ASSERT_TRUE(ps2.Insert("Accept", 2, PatternOptions()));
+    ps2.Build();
+
+    {
+        std::set<T> res{1};
+        ASSERT_EQ(ps2.Find("CONTENT-TYPE: text; ACCEPT"), res);
+    }
+
+    ASSERT_TRUE(ps2.Delete("content-type", 1));
+    ASSERT_EQ(ps2.Size(), 1);
 }
 
-TEST (Aho, RandomTests) {
-    randomTest<Aho>();
+// caseless and case sensitive patterns in one dictionary are compared with the naive search
+template<template <typename> class PatternSearchT, typename T = int>
+void caselessRandomTest(const int LEN_T = 1000, const int CNT_W = 100, const int LEN_W = 6, const int CNT_TESTS = 100) {
+    const char alphabet[] = "aAbB1";
+    const PatternOptions caseless(PatternOptions::kCaseless);
+
+    for (int i = 0; i < CNT_TESTS; ++i) {
+        PatternSearchT<T> ps;
+        vector<pair<string, bool>> words;
+
+        const int cntWords = rand() % CNT_W + 1;
+        for (int j = 0; j < cntWords; ++j) {
+            string word(rand() % LEN_W + 1, 'a');
+            for (char& c: word) {
+                c = alphabet[rand() % 5];
+            }
+
+            bool fold = rand() % 2;
+            ASSERT_TRUE(ps.Insert(word, j, fold ? caseless : PatternOptions()));
+            words.push_back({word, fold});
+        }
+
+        for (int j = 0; j < cntWords; ++j) {
+            if (rand() % 4 == 0) {
+                ASSERT_TRUE(ps.Delete(words[j].first, j, words[j].second ? caseless : PatternOptions()));
+                words[j].first.clear();
+            }
+        }
+        ps.Build();
+
+        string text(rand() % LEN_T + 1, 'a');
+        for (char& c: text) {
+            c = alphabet[rand() % 5];
+        }
+        const string foldedText = AsciiFold(text.c_str(), text.size());
+
+        std::set<T> res;
+        for (int j = 0; j < cntWords; ++j) {
+            const string& word = words[j].first;
+            if (word.empty()) continue;
+
+            bool found = words[j].second ? foldedText.find(AsciiFold(word.c_str(), word.size())) != string::npos
+                                         : text.find(word) != string::npos;
+            if (found) res.insert(j);
+        }
+
+        ASSERT_EQ(ps.Find(text), res);
+
+        vector<TextSegment> segments;
+        for (size_t pos = 0; pos < text.size(); ) {
+            size_t len = std::min<size_t>(rand() % LEN_W, text.size() - pos);
+            segments.push_back(TextSegment{text.c_str() + pos, len});
+            pos += len;
+        }
+
+        ASSERT_EQ(ps.Find(segments.data(), segments.size()), res);
+    }
 }
 
-TEST (Aho, WorstCaseTest) {
-    WorstCaseTest<Aho>();
+template<template <typename> class PatternSearchT, typename T = int>
+void positionTest() {
+    const PatternOptions start(PatternOptions::kAnchoredStart);
+    const PatternOptions end(PatternOptions::kAnchoredEnd);
+    const PatternOptions word(PatternOptions::kWordBoundary);
+    PatternSearchT<T> ps;
+
+    ASSERT_TRUE(ps.Insert("GET", 1, start));
+    ASSERT_TRUE(ps.Insert("\r\n\r\n", 2, end));
+    ASSERT_TRUE(ps.Insert("id", 3, word));
+    ASSERT_TRUE(ps.Insert("GET /", 4, PatternOptions(PatternOptions::kAnchoredStart | PatternOptions::kAnchoredEnd)));
+    ASSERT_TRUE(ps.Insert("get", 5, PatternOptions(PatternOptions::kAnchoredStart | PatternOptions::kCaseless)));
+    ASSERT_TRUE(ps.Insert("GET", 6));
+    ASSERT_FALSE(ps.Insert("GET", 1, start));
+    ASSERT_TRUE(ps.Insert("GET", 1, word));
+    ASSERT_EQ(ps.Size(), 7);
+    ps.Build();
+
+    {
+        std::set<T> res{1, 2, 3, 5, 6};
+        ASSERT_EQ(ps.Find("GET /?id=1 HTTP/1.1\r\nHost: ids\r\n\r\n"), res);
+    }
+
+    ASSERT_EQ(ps.Find("get /?uid=1\r\n\r\n\r\n "), std::set<T>{5});
+    ASSERT_EQ(ps.Find("GET /"), (std::set<T>{1, 4, 5, 6}));
+    ASSERT_EQ(ps.Find("x GET /"), (std::set<T>{1, 6}));
+
+    ASSERT_FALSE(ps.Delete("GET", 6, start));
+    ASSERT_TRUE(ps.Delete("GET", 1, start));
+    ASSERT_TRUE(ps.Delete("gEt", 5, PatternOptions(PatternOptions::kAnchoredStart | PatternOptions::kCaseless)));
+    ps.Build();
+
+    std::set<T> res{1, 6};
+    ASSERT_EQ(ps.Find("GET id2"), res);
 }
 
-TEST (Aho, WorstCaseNotMatchTest) {
-    WorstCaseTest<Aho>(true);
+// patterns with random position options are compared with the naive search
+template<template <typename> class PatternSearchT, typename T = int>
+void positionRandomTest(const int LEN_T = 100, const int CNT_W = 50, const int LEN_W = 4, const int CNT_TESTS = 300) {
+    const char alphabet[] = "ab -";
+    const unsigned flags[] = {PatternOptions::kAnchoredStart, PatternOptions::kAnchoredEnd, PatternOptions::kWordBoundary};
+
+    for (int i = 0; i < CNT_TESTS; ++i) {
+        PatternSearchT<T> ps;
+        vector<pair<string, PatternOptions>> words;
+
+        const int cntWords = rand() % CNT_W + 1;
+        for (int j = 0; j < cntWords; ++j) {
+            string word(rand() % LEN_W + 1, 'a');
+            for (char& c: word) {
+                c = alphabet[rand() % 4];
+            }
+
+            PatternOptions options;
+            for (unsigned f: flags) {
+                if (rand() % 3 == 0) options.flags |= f;
+            }
+
+            ASSERT_TRUE(ps.Insert(word, j, options));
+            words.push_back({word, options});
+        }
+        ps.Build();
+
+        string text(rand() % LEN_T + 1, 'a');
+        for (char& c: text) {
+            c = alphabet[rand() % 4];
+        }
+
+        std::set<T> res;
+        for (int j = 0; j < cntWords; ++j) {
+            const string& word = words[j].first;
+            TextSegment segment{text.c_str(), text.size()};
+            TextView view(&segment, 1);
+
+            for (size_t pos = text.find(word); pos != string::npos; pos = text.find(word, pos + 1)) {
+                if (IsPlaced(words[j].second, view, pos, pos + word.size())) {
+                    res.insert(j);
+                }
+            }
+        }
+
+        ASSERT_EQ(ps.Find(text), res);
+
+        vector<TextSegment> segments;
+        for (size_t pos = 0; pos < text.size(); ) {
+            size_t len = std::min<size_t>(rand() % LEN_W, text.size() - pos);
+            segments.push_back(TextSegment{text.c_str() + pos, len});
+            pos += len;
+        }
+
+        ASSERT_EQ(ps.Find(segments.data(), segments.size()), res);
+    }
 }
 
-TEST (TrieSearch, ManualTests) {
-    manualTest<TrieSearch>();
+// caseless utf-8 patterns are compared with the naive search in the folded text
+template<template <typename> class PatternSearchT, typename T = int>
+void utf8RandomTest(const int LEN_T = 300, const int CNT_W = 50, const int LEN_W = 4, const int CNT_TESTS = 300) {
+    const char * alphabet[] = {"a", "A", "1", " ", "\xd0\xb1", "\xd0\x91", "\xd1\x91", "\xd0\x81", "\xcf\x82", "\xce\xa3"};
+    const unsigned flags[] = {PatternOptions::kNone, PatternOptions::kCaseless, PatternOptions::kCaseless | PatternOptions::kUtf8};
+    const Utf8Folding& folding = Utf8Folding::Instance();
+
+    for (int i = 0; i < CNT_TESTS; ++i) {
+        PatternSearchT<T> ps;
+        vector<pair<string, PatternOptions>> words;
+
+        const int cntWords = rand() % CNT_W + 1;
+        for (int j = 0; j < cntWords; ++j) {
+            string word;
+            for (int k = rand() % LEN_W + 1; k > 0; --k) {
+                word += alphabet[rand() % 10];
+            }
+
+            PatternOptions options(flags[rand() % 3]);
+            ASSERT_TRUE(ps.Insert(word, j, options));
+            words.push_back({word, options});
+        }
+        ps.Build();
+
+        string text;
+        for (int k = rand() % LEN_T + 1; k > 0; --k) {
+            text += alphabet[rand() % 10];
+        }
+
+        std::set<T> res;
+        for (int j = 0; j < cntWords; ++j) {
+            const string& word = words[j].first;
+            bool found;
+
+            if (!words[j].second.Has(PatternOptions::kCaseless)) {
+                found = text.find(word) != string::npos;
+            } else if (!words[j].second.Has(PatternOptions::kUtf8)) {
+                found = AsciiFold(text.c_str(), text.size()).find(AsciiFold(word.c_str(), word.size())) != string::npos;
+            } else {
+                found = folding.Fold(text.c_str(), text.size()).find(folding.Fold(word.c_str(), word.size())) != string::npos;
+            }
+
+            if (found) res.insert(j);
+        }
+
+        ASSERT_EQ(ps.Find(text), res);
+
+        // two-byte sequences are split by the segments too
+        vector<TextSegment> segments;
+        for (size_t pos = 0; pos < text.size(); ) {
+            size_t len = std::min<size_t>(rand() % LEN_W, text.size() - pos);
+            segments.push_back(TextSegment{text.c_str() + pos, len});
+            pos += len;
+        }
+
+        ASSERT_EQ(ps.Find(segments.data(), segments.size()), res);
+    }
 }
 
-TEST (TrieSearch, RandomTests) {
-    randomTest<TrieSearch>();
+TEST (Hyperscan, MixedLiteralRegexTest) {
+    Hyperscan<int> ps;
+    const PatternOptions literal(PatternOptions::kLiteral);
+    const std::string withZero("a\0b", 3);
+
+    ASSERT_TRUE(ps.Insert(".*Put.n.*", 1));
+    ASSERT_TRUE(ps.Insert(".*Put.n.*", 2, literal));
+    ASSERT_TRUE(ps.Insert(withZero, 3, literal));
+    ASSERT_FALSE(ps.Insert(".*Put.n.*", 2, literal));
+    ASSERT_EQ(ps.Size(), 3);
+    ps.Build();
+
+    {
+        std::set<int> res{1};
+        ASSERT_EQ(ps.Find("Putin"), res);
+    }
+
+    {
+        std::set<int> res{1, 2, 3};
+        ASSERT_EQ(ps.Find("x.*Put.n.*x" + withZero), res);
+    }
+
+    {
+        std::set<int> res;
+        ASSERT_EQ(ps.Find("a b"), res);
+    }
+
+    ASSERT_FALSE(ps.Delete(".*Put.n.*", 2));
+    ASSERT_TRUE(ps.Delete(".*Put.n.*", 2, literal));
+    ps.Build();
+
+    std::set<int> res{1, 3};
+    ASSERT_EQ(ps.Find("x.*Put.n.*x" + withZero), res);
 }
 
-TEST (TrieSearch, WorstCaseTest) {
-    WorstCaseTest<TrieSearch>();
+TEST (Hyperscan, PatternFlagsTest) {
+    Hyperscan<int> ps;
+
+    ASSERT_TRUE(ps.Insert("Host:", 1, PatternOptions(PatternOptions::kCaseless | PatternOptions::kLiteral)));
+    ASSERT_TRUE(ps.Insert("user-agent", 2, PatternOptions(PatternOptions::kCaseless)));
+    ASSERT_TRUE(ps.Insert("Cookie", 3));
+    ASSERT_TRUE(ps.Insert("a.b", 4, PatternOptions(PatternOptions::kDotAll)));
+    ASSERT_TRUE(ps.Insert("a.b", 5));
+    ASSERT_TRUE(ps.Insert("^GET", 6, PatternOptions(PatternOptions::kMultiLine)));
+    ASSERT_TRUE(ps.Insert("^GET", 7));
+    ASSERT_TRUE(ps.Insert("abc", 8, PatternOptions(PatternOptions::kSomLeftmost)));
+    ASSERT_FALSE(ps.Insert("abc", 9, PatternOptions(PatternOptions::kLiteral | PatternOptions::kWordBoundary)));
+    ps.Build();
+
+    {
+        std::set<int> res{1, 2};
+        ASSERT_EQ(ps.Find("HOST: x USER-AGENT: cookie"), res);
+    }
+
+    {
+        std::set<int> res{4};
+        ASSERT_EQ(ps.Find("a\nb"), res);
+    }
+
+    {
+        std::set<int> res{4, 5, 6};
+        ASSERT_EQ(ps.Find("axb\nGET /"), res);
+    }
+
+    {
+        std::set<int> res{7, 6, 8};
+        ASSERT_EQ(ps.Find("GET /abc"), res);
+    }
 }
 
-TEST (TrieSearch, WorstCaseNotMatchTest) {
-    WorstCaseTest<TrieSearch>(true);
+TEST (Hyperscan, ConcurrentBuildTest) {
+    const int CNT_THREADS = 8;
+
+    // every instance has its own number of patterns
+    std::vector<std::thread> threads;
+    for (int i = 0; i < CNT_THREADS; ++i) {
+        threads.emplace_back([i]() {
+            Hyperscan<int> ps;
+            std::set<int> res;
+
+            for (int j = 0; j <= i * 10; ++j) {
+                ps.Insert("p" + std::to_string(j) + "x", j);
+                res.insert(j);
+            }
+
+            for (int k = 0; k < 10; ++k) {
+                ps.Build();
+            }
+
+            std::string text;
+            for (int j = 0; j <= i * 10; ++j) {
+                text += "p" + std::to_string(j) + "x ";
+            }
+
+            ASSERT_EQ(ps.Find(text), res);
+        });
+    }
+
+    for (auto& t: threads) {
+        t.join();
+    }
+}
+
+TEST (Hyperscan, BackgroundBuildTest) {
+    Hyperscan<int> ps;
+    ps.StartBackgroundBuild(std::chrono::milliseconds(50));
+
+    std::set<int> res;
+    std::string text;
+    for (int i = 0; i < 100; ++i) {
+        std::string p = "p" + std::to_string(i) + "x";
+        ASSERT_TRUE(ps.Insert(p, i));
+        res.insert(i);
+        text += p + " ";
+    }
+
+    uint64_t version = ps.Version();
+    ASSERT_EQ(version, 100);
+    ASSERT_TRUE(ps.WaitForGeneration(version, std::chrono::seconds(10)));
+    ASSERT_GE(ps.Generation(), version);
+    ASSERT_EQ(ps.Find(text), res);
+
+    // readers scan the published databases while the writer updates the rule set
+    std::atomic<bool> stop(false);
+    std::thread reader([&]() {
+        while (!stop) {
+            std::set<int> r = ps.Find(text);
+            ASSERT_TRUE(r.size() >= 50 && r.size() <= 100);
+        }
+    });
+
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_TRUE(ps.Delete("p" + std::to_string(i) + "x", i));
+        res.erase(i);
+    }
+
+    version = ps.Version();
+    ASSERT_TRUE(ps.WaitForGeneration(version, std::chrono::seconds(10)));
+    ASSERT_EQ(ps.Find(text), res);
+
+    stop = true;
+    reader.join();
+
+    ps.StopBackgroundBuild();
+    ASSERT_TRUE(ps.Insert("p0x", 0));
+    ASSERT_FALSE(ps.WaitForGeneration(ps.Version(), std::chrono::milliseconds(200)));
+}
+
+TEST (Hyperscan, ManualTests) {
+    manualTest<HyperscanAddDotAll>();
+}
+
+TEST (Hyperscan, ManualRegexTests) {
+    manualRegexTests<Hyperscan>();
+}
+
+TEST (Hyperscan, ManualRegexEscapedTests) {
+    manualRegexEscapedTests<HyperscanWithEscapedCharacter>();
+}
+
+
+TEST (Hyperscan, RandomTests) {
+    randomTest<HyperscanAddDotAll>(100);
+}
+
+TEST (Hyperscan, SimpleMultiThreadingTest) {
+    SimpleMultiThreadingTest<HyperscanAddDotAll>();
+}
+
+TEST (Hyperscan, manualSwmrThreadingTest) {
+    manualSwmrThreadingTest<HyperscanAddDotAll>();
+}
+
+TEST (Hyperscan, WorstCaseTest) {
+    WorstCaseTest<HyperscanAddDotAll>();
+}
+
+TEST (Hyperscan, WorstCaseNotMatchTest) {
+    WorstCaseTest<HyperscanAddDotAll>(true);
+}
+
+TEST (Hyperscan, LengthDelimitedTest) {
+    lengthDelimitedTest<Hyperscan>();
+}
+
+TEST (HyperscanSharded, ManualTests) {
+    manualTest<HyperscanSharded>();
+}
+
+TEST (HyperscanSharded, RandomTests) {
+    randomTest<HyperscanSharded>(100);
+}
+
+TEST (HyperscanSharded, manualSwmrThreadingTest) {
+    manualSwmrThreadingTest<HyperscanSharded>();
+}
+
+TEST (HyperscanVectored, ManualTests) {
+    manualTest<HyperscanVectored>();
+}
+
+TEST (HyperscanVectored, VectoredTest) {
+    vectoredTest<HyperscanVectored>();
+}
+
+TEST (Hyperscan, MemoryTest) {
+    MemoryStats m = memoryTest<Hyperscan>();
+    ASSERT_GT(m.database, 0);
+    ASSERT_GT(m.scratch, 0);
+}
+
+TEST (Hyperscan, VectoredTest) {
+    vectoredTest<HyperscanAddDotAll>();
+}
+
+TEST (HyperscanLiteral, ManualTests) {
+    manualTest<HyperscanLiteral>();
+}
+
+TEST (HyperscanLiteral, RandomTests) {
+    randomTest<HyperscanLiteral>(100);
+}
+
+TEST (HybridSearch, ManualTests) {
+    manualTest<HybridSearch>();
+}
+
+TEST (HybridSearch, ManualRegexTests) {
+    manualRegexTests<HybridSearch>();
+}
+
+TEST (HybridSearch, RandomTests) {
+    randomTest<HybridSearch>();
+}
+
+TEST (HybridSearch, CaselessTest) {
+    caselessTest<HybridSearch>();
+}
+
+TEST (HybridSearch, PositionTest) {
+    positionTest<HybridSearch>();
+}
+
+TEST (HybridSearch, ToLiteralTest) {
+    std::string literal;
+    const PatternOptions none;
+
+    ASSERT_TRUE(HybridSearch<int>::ToLiteral("abc", 3, none, literal));
+    ASSERT_EQ(literal, "abc");
+
+    ASSERT_TRUE(HybridSearch<int>::ToLiteral("\\.\\*Put\\.n", 10, none, literal));
+    ASSERT_EQ(literal, ".*Put.n");
+
+    ASSERT_TRUE(HybridSearch<int>::ToLiteral(".*", 2, PatternOptions(PatternOptions::kLiteral), literal));
+    ASSERT_EQ(literal, ".*");
+
+    ASSERT_FALSE(HybridSearch<int>::ToLiteral(".*Put", 5, none, literal));
+    ASSERT_FALSE(HybridSearch<int>::ToLiteral("a\\d", 3, none, literal));
+    ASSERT_FALSE(HybridSearch<int>::ToLiteral("a\\", 2, none, literal));
+    ASSERT_TRUE(HybridSearch<int>::ToLiteral("abc", 3, PatternOptions(PatternOptions::kCaseless), literal));
+    ASSERT_FALSE(HybridSearch<int>::ToLiteral("abc", 3, PatternOptions(PatternOptions::kDotAll), literal));
+}
+
+TEST (AhoRegex, ManualTests) {
+    manualTest<AhoRegex>();
+}
+
+TEST (AhoRegex, ManualRegexTests) {
+    manualRegexTests<AhoRegex>();
+}
+
+TEST (AhoRegex, RandomTests) {
+    randomTest<AhoRegex>(1000);
+}
+
+TEST (AhoRegex, RequiredFactorsTest) {
+    auto factors = [](const std::string& pattern) {
+        std::vector<std::string> res;
+        if (!AhoRegex<int>::RequiredFactors(pattern.c_str(), pattern.size(), res)) {
+            res.push_back("<none>");
+        }
+        return res;
+    };
+
+    ASSERT_EQ(factors(".*Put.n.*"), (std::vector<std::string>{"Put", "n"}));
+    ASSERT_EQ(factors(".*Boo.*mba.*"), (std::vector<std::string>{"Boo", "mba"}));
+    ASSERT_EQ(factors("\\.\\*Put\\.n\\.\\*"), (std::vector<std::string>{".*Put.n.*"}));
+    ASSERT_EQ(factors(".*\\\\te.ac.\\\\.*"), (std::vector<std::string>{"\\te", "ac", "\\"}));
+    ASSERT_EQ(factors("abc?d+e{0,2}f{2}[gh]+(ij)*k\\dl"), (std::vector<std::string>{"ab", "d", "f", "k", "l"}));
+    ASSERT_EQ(factors("x(a|b)y"), (std::vector<std::string>{"x", "y"}));
+    ASSERT_EQ(factors("[)]z"), (std::vector<std::string>{"z"}));
+    ASSERT_EQ(factors("ab|cd"), (std::vector<std::string>{"<none>"}));
+    ASSERT_EQ(factors("a\\x41"), (std::vector<std::string>{"<none>"}));
+}
+
+TEST (AhoRegex, UnfilteredAndLiteralTest) {
+    AhoRegex<int> ps;
+
+    ASSERT_TRUE(ps.Insert("\\d+", 1));
+    ASSERT_TRUE(ps.Insert("put|get", 2));
+    ASSERT_TRUE(ps.Insert("a.*", 3, PatternOptions(PatternOptions::kLiteral)));
+    ASSERT_TRUE(ps.Insert("HOST", 4, PatternOptions(PatternOptions::kCaseless)));
+    ASSERT_TRUE(ps.Insert("x.y", 5, PatternOptions(PatternOptions::kDotAll)));
+    ASSERT_FALSE(ps.Insert("(", 6));
+    ASSERT_FALSE(ps.Insert("^a", 7, PatternOptions(PatternOptions::kMultiLine)));
+    ASSERT_EQ(ps.Size(), 5);
+    ps.Build();
+
+    {
+        std::set<int> res{1, 2, 4};
+        ASSERT_EQ(ps.Find("get 42 host"), res);
+    }
+
+    {
+        std::set<int> res{3, 5};
+        ASSERT_EQ(ps.Find("a.* x\ny"), res);
+    }
+
+    ASSERT_TRUE(ps.Delete("a.*", 3, PatternOptions(PatternOptions::kLiteral)));
+    ASSERT_FALSE(ps.Delete("a.*", 3));
+    ps.Build();
+
+    std::set<int> res{5};
+    ASSERT_EQ(ps.Find("a.* x\ny"), res);
+}
+
+TEST (AhoRegex, CaselessLiteralTest) {
+    AhoRegex<int> ps;
+    const PatternOptions caseless(PatternOptions::kLiteral | PatternOptions::kCaseless);
+
+    ASSERT_TRUE(ps.Insert("Host", 1, caseless));
+    ASSERT_TRUE(ps.Insert("HOST", 2, caseless));
+    ASSERT_TRUE(ps.Insert("host", 3, PatternOptions(PatternOptions::kLiteral)));
+    ps.Build();
+
+    {
+        std::set<int> res{1, 2};
+        ASSERT_EQ(ps.Find("HOST: a"), res);
+    }
+
+    {
+        std::set<int> res{1, 2, 3};
+        ASSERT_EQ(ps.Find("host: a"), res);
+    }
+
+    ASSERT_TRUE(ps.Delete("Host", 1, caseless));
+    ASSERT_FALSE(ps.Delete("host", 1, caseless));
+    ps.Build();
+
+    std::set<int> res{2};
+    ASSERT_EQ(ps.Find("hOsT: a"), res);
+}
+
+TEST (LinearSearch, MemoryTest) {
+    memoryTest<LinearSearch>();
+}
+
+TEST (LinearSearch, ManualTests) {
+    manualTest<LinearSearch>();
+}
+
+TEST (LinearSearch, WorstCaseTest) {
+    WorstCaseTest<LinearSearch>();
+}
+
+// so hard for LinearSearch
+//TEST (LinearSearch, WorstCaseNotMatchTest) {
+//    WorstCaseTest<LinearSearch>(true);
+//}
+
+TEST (Aho, ManualTests) {
+    manualTest<Aho>();
+}
+
+TEST (Aho, LengthDelimitedTest) {
+    lengthDelimitedTest<Aho>();
+}
+
+TEST (Aho, SharedDataTest) {
+    sharedDataTest<Aho>();
+}
+
+TEST (Aho, MemoryTest) {
+    memoryTest<Aho>();
+
+    Aho<int> ps;
+    ps.Insert("abcd", 0);
+    ps.Insert("bcx", 1);
+    ps.Build();
+    ASSERT_GE(ps.MemoryUsage().transitions, ps.States() * Aho<int>::kRowSize);
+}
+
+TEST (Aho, VectoredTest) {
+    vectoredTest<Aho>();
+}
+
+TEST (Aho, CaselessTest) {
+    caselessTest<Aho>();
+}
+
+TEST (Aho, CaselessRandomTest) {
+    caselessRandomTest<Aho>();
+}
+
+TEST (Aho, PositionTest) {
+    positionTest<Aho>();
+}
+
+TEST (Aho, PositionRandomTest) {
+    positionRandomTest<Aho>();
+}
+
+TEST (Aho, Utf8Test) {
+    const PatternOptions utf8(PatternOptions::kCaseless | PatternOptions::kUtf8);
+    Aho<int> ps;
+
+    ASSERT_TRUE(ps.Insert("\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", 1, utf8)); // "Привет"
+    ASSERT_TRUE(ps.Insert("\xd0\xbc\xd0\xb8\xd1\x80", 2));                                   // "мир"
+    ASSERT_TRUE(ps.Insert("\xcf\x83\xce\xbf\xcf\x86\xce\xbf\xcf\x82", 3, utf8));          // "σοφος"
+    ASSERT_TRUE(ps.Insert("\xd0\xb4\xd0\xbe\xd0\xbc", 4, PatternOptions(PatternOptions::kCaseless))); // "дом", ascii caseless
+    ASSERT_TRUE(ps.Insert("Host", 5, utf8));
+    ASSERT_FALSE(ps.Insert("host", 5, PatternOptions(PatternOptions::kCaseless)));
+    ASSERT_FALSE(ps.Insert("\xd0", 6, utf8));
+    ASSERT_FALSE(ps.Insert("\xc0\xaf", 6, utf8));
+    ASSERT_EQ(ps.Size(), 5);
+    ps.Build();
+
+    {
+        // "ПРИВЕТ, МИР! ΣΟΦΟΣ ДОМ HOST"
+        std::set<int> res{1, 3, 5};
+        ASSERT_EQ(ps.Find("\xd0\x9f\xd0\xa0\xd0\x98\xd0\x92\xd0\x95\xd0\xa2, \xd0\x9c\xd0\x98\xd0\xa0! "
+                          "\xce\xa3\xce\x9f\xce\xa6\xce\x9f\xce\xa3 \xd0\x94\xd0\x9e\xd0\x9c HOST"), res);
+    }
+
+    {
+        // "привет, мир! дом"
+        std::set<int> res{1, 2, 4};
+        ASSERT_EQ(ps.Find("\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82, \xd0\xbc\xd0\xb8\xd1\x80! \xd0\xb4\xd0\xbe\xd0\xbc"), res);
+    }
+
+    ASSERT_TRUE(ps.Delete("\xd0\x9f\xd0\xa0\xd0\x98\xd0\x92\xd0\x95\xd0\xa2", 1, utf8));
+    ASSERT_TRUE(ps.Delete("HOST", 5, PatternOptions(PatternOptions::kCaseless)));
+    ASSERT_EQ(ps.Size(), 3);
+}
+
+// the rules of the ascii folded trie are inserted again into the utf-8 folded one with their own bytes
+TEST (Aho, Utf8RefoldTest) {
+    const PatternOptions caseless(PatternOptions::kCaseless);
+    Aho<int> ps;
+
+    ASSERT_TRUE(ps.Insert("B\xd0\x94", 0, caseless)); // "BД"
+    ASSERT_TRUE(ps.Insert("Host", 1, caseless));
+    ASSERT_FALSE(ps.Insert("b\xd0\x94", 0, caseless));
+    ASSERT_TRUE(ps.Insert("\xd0\x80", 4, PatternOptions(PatternOptions::kCaseless | PatternOptions::kUtf8)));
+    ASSERT_EQ(ps.Size(), 3);
+    ASSERT_FALSE(ps.Insert("b\xd0\x94", 0, caseless));
+    ps.Build();
+
+    {
+        std::set<int> res{0, 1};
+        ASSERT_EQ(ps.Find("b\xd0\x94 HOST"), res);
+    }
+
+    ASSERT_TRUE(ps.Delete("B\xd0\x94", 0, caseless));
+    ASSERT_FALSE(ps.Delete("B\xd0\x94", 0, caseless));
+    ASSERT_TRUE(ps.Delete("HOST", 1, caseless));
+    ASSERT_EQ(ps.Size(), 1);
+
+    ASSERT_TRUE(ps.Insert("B\xd0\x94", 0, caseless));
+    ASSERT_EQ(ps.Size(), 2);
+}
+
+TEST (Aho, Utf8RandomTest) {
+    utf8RandomTest<Aho>();
+}
+
+TEST (Aho, ShortPatternsTest) {
+    Aho<int> ps;
+    ASSERT_TRUE(ps.Insert("a", 0));
+    ASSERT_TRUE(ps.Insert("bc", 1));
+    ASSERT_TRUE(ps.Insert("Xy", 2, PatternOptions(PatternOptions::kCaseless)));
+    ASSERT_TRUE(ps.Insert("\xff\x00", 3));
+    ASSERT_FALSE(ps.Insert("a", 0));
+    ps.Build();
+
+    // short patterns aren't in the automaton
+    ASSERT_EQ(ps.States(), 1);
+    ASSERT_EQ(ps.Size(), 4);
+
+    ASSERT_EQ(ps.Find("xbca"), std::set<int>({0, 1}));
+    ASSERT_EQ(ps.Find("cb xY"), std::set<int>({2}));
+    ASSERT_EQ(ps.Find(std::string("\xff\x00", 2)), std::set<int>({3}));
+
+    // pairs are split by the segments
+    TextSegment segments[] = {{"xb", 2}, {"", 0}, {"cX", 2}, {"Y", 1}};
+    ASSERT_EQ(ps.Find(segments, 4), std::set<int>({1, 2}));
+
+    // results of the tables and the automaton are merged
+    ASSERT_TRUE(ps.Insert("bcd", 4));
+    ps.Build();
+    ASSERT_EQ(ps.Find("abcd"), std::set<int>({0, 1, 4}));
+
+    ASSERT_TRUE(ps.Delete("bc", 1));
+    ASSERT_FALSE(ps.Delete("bc", 1));
+    ASSERT_FALSE(ps.Delete("xy", 2));
+    ASSERT_TRUE(ps.Delete("xy", 2, PatternOptions(PatternOptions::kCaseless)));
+    ps.Build();
+    ASSERT_EQ(ps.Find("abcdxy"), std::set<int>({0, 4}));
+}
+
+TEST (Aho, ShortRandomTest) {
+    randomTest<Aho>(1000, 100, 10, 3, 4);
+    caselessRandomTest<Aho>(1000, 100, 3);
+    vectoredTest<Aho>(1000, 100, 3, 4);
+}
+
+TEST (Aho, SimpleMultiThreadingTest) {
+    SimpleMultiThreadingTest<Aho>();
+}
+
+TEST (Aho, RandomTests) {
+    randomTest<Aho>();
+}
+
+TEST (Aho, WorstCaseTest) {
+    WorstCaseTest<Aho>();
+}
+
+TEST (Aho, WorstCaseNotMatchTest) {
+    WorstCaseTest<Aho>(true);
+}
+
+TEST (AhoLazy, ManualTests) {
+    manualTest<AhoLazy>();
+}
+
+TEST (AhoLazy, RandomTests) {
+    randomTest<AhoLazy>();
+}
+
+TEST (AhoLazy, SimpleMultiThreadingTest) {
+    SimpleMultiThreadingTest<AhoLazy>();
+}
+
+TEST (AhoLazy, CaselessRandomTest) {
+    caselessRandomTest<AhoLazy>();
+}
+
+TEST (AhoLazy, Utf8RandomTest) {
+    utf8RandomTest<AhoLazy>();
+}
+
+TEST (AhoLazySmallBudget, RandomTests) {
+    randomTest<AhoLazySmallBudget>();
+}
+
+TEST (AhoLazySmallBudget, SimpleMultiThreadingTest) {
+    SimpleMultiThreadingTest<AhoLazySmallBudget>();
+}
+
+TEST (AhoLazySmallBudget, BudgetTest) {
+    AhoLazySmallBudget<int> ps;
+    for (int i = 0; i < 100; ++i) {
+        ps.Insert(std::to_string(i * 7919), i);
+    }
+    ps.Build();
+
+    // only the row of the root is computed by `Build`
+    ASSERT_EQ(ps.Rows(), 1);
+
+    std::string text;
+    for (int i = 0; i < 1000; ++i) {
+        text += std::to_string(i * 7);
+    }
+
+    std::set<int> res;
+    for (int i = 0; i < 100; ++i) {
+        if (text.find(std::to_string(i * 7919)) != std::string::npos) {
+            res.insert(i);
+        }
+    }
+
+    ASSERT_EQ(ps.Find(text), res);
+    ASSERT_EQ(ps.Rows(), 8);
+}
+
+TEST (AhoSparse, ManualTests) {
+    manualTest<AhoSparse>();
+}
+
+TEST (AhoSparse, RandomTests) {
+    randomTest<AhoSparse>();
+}
+
+TEST (AhoSparse, SimpleMultiThreadingTest) {
+    SimpleMultiThreadingTest<AhoSparse>();
+}
+
+TEST (AhoSparse, CaselessRandomTest) {
+    caselessRandomTest<AhoSparse>();
+}
+
+TEST (AhoSparse, Utf8RandomTest) {
+    utf8RandomTest<AhoSparse>();
+}
+
+TEST (AhoSparse, PositionRandomTest) {
+    positionRandomTest<AhoSparse>();
+}
+
+TEST (AhoSparse, MemoryTest) {
+    Aho<int> dense;
+    AhoSparse<int> sparse;
+    for (int i = 0; i < 100; ++i) {
+        dense.Insert(std::to_string(i * 7919), i);
+        sparse.Insert(std::to_string(i * 7919), i);
+    }
+    dense.Build();
+    sparse.Build();
+
+    ASSERT_EQ(sparse.States(), dense.States());
+    ASSERT_EQ(dense.Rows(), dense.States());
+    ASSERT_EQ(sparse.Rows(), 1);
+    ASSERT_LT(sparse.TransitionMemory() * 10, dense.TransitionMemory());
+    ASSERT_LT(sparse.MemoryUsage().transitions * 10, dense.MemoryUsage().transitions);
+
+    memoryTest<AhoSparse>();
+}
+
+TEST (AhoTruncated, ManualTests) {
+    manualTest<AhoTruncated>();
+}
+
+TEST (AhoTruncated, RandomTests) {
+    randomTest<AhoTruncated>(1000, 100, 10, 12, 2);
+}
+
+TEST (AhoTruncated, CaselessRandomTest) {
+    caselessRandomTest<AhoTruncated>(1000, 100, 12);
+}
+
+TEST (AhoTruncated, PositionRandomTest) {
+    positionRandomTest<AhoTruncated>(100, 50, 8);
+}
+
+TEST (AhoTruncated, Utf8RandomTest) {
+    utf8RandomTest<AhoTruncated>(300, 50, 8);
+}
+
+TEST (AhoTruncated, StatesTest) {
+    AhoTruncated<int> ps;
+    ASSERT_TRUE(ps.Insert(string(300, 'a') + "b", 0));
+    ASSERT_TRUE(ps.Insert(string(300, 'a') + "c", 1));
+    ASSERT_TRUE(ps.Insert("aab", 2));
+    ps.Build();
+
+    // the root, "a", "aa", "aaa", "aaaa" and "aab"
+    ASSERT_EQ(ps.States(), 6);
+
+    ASSERT_EQ(ps.Find(string(400, 'a') + "c"), std::set<int>({1}));
+    ASSERT_EQ(ps.Find(string(300, 'a')), std::set<int>());
+    ASSERT_EQ(ps.Find(string(299, 'a') + "bc"), std::set<int>({2}));
+
+    ASSERT_TRUE(ps.Delete(string(300, 'a') + "c", 1));
+    ASSERT_FALSE(ps.Delete(string(300, 'a') + "c", 1));
+    ps.Build();
+
+    ASSERT_EQ(ps.Find(string(400, 'a') + "bc"), std::set<int>({0, 2}));
+}
+
+TEST (AhoHybrid, ManualTests) {
+    manualTest<AhoHybrid>();
+}
+
+TEST (AhoHybrid, RandomTests) {
+    randomTest<AhoHybrid>();
+}
+
+TEST (AhoHybrid, SimpleMultiThreadingTest) {
+    SimpleMultiThreadingTest<AhoHybrid>();
+}
+
+TEST (AhoHybrid, CaselessRandomTest) {
+    caselessRandomTest<AhoHybrid>();
+}
+
+TEST (AhoHybrid, Utf8RandomTest) {
+    utf8RandomTest<AhoHybrid>();
+}
+
+TEST (AhoHybridSmallBlock, RandomTests) {
+    randomTest<AhoHybridSmallBlock>();
+}
+
+TEST (AhoHybridSmallBlock, CaselessRandomTest) {
+    caselessRandomTest<AhoHybridSmallBlock>();
+}
+
+TEST (AhoHybridSmallBlock, BlockTest) {
+    AhoHybridSmallBlock<int> ps;
+    ps.Insert("abc", 0);
+    ps.Insert("abd", 1);
+    ps.Insert("bcd", 2);
+    ps.Build();
+
+    // the root, "a", "b" and "ab" have the rows, "bc" is the depth 2 state which doesn't fit into the block
+    ASSERT_EQ(ps.States(), 8);
+    ASSERT_EQ(ps.Rows(), 4);
+    ASSERT_EQ(ps.Find("xabcdx"), std::set<int>({0, 2}));
+
+    // the block is rebuilt
+    ps.Delete("abd", 1);
+    ps.Insert("bd", 3);
+    ps.Build();
+
+    ASSERT_EQ(ps.Rows(), 4);
+    ASSERT_EQ(ps.Find("abcbd"), std::set<int>({0, 3}));
+}
+
+namespace {
+
+constexpr auto kStaticMethods = MakeStaticAho("GET", "POST", "PUT", "HEAD", "HTTP/1.1", "ET", "");
+
+// the automaton is built by the compiler
+static_assert(kStaticMethods.States() == 23, "");
+static_assert(kStaticMethods.Next(kStaticMethods.Next(0, 'P'), 'E') == kStaticMethods.Next(0, 'E'), "");
+static_assert(kStaticMethods.Next(kStaticMethods.Next(0, 'P'), 'X') == 0, "");
+
+}
+
+TEST (StaticAho, ManualTests) {
+    ASSERT_EQ(kStaticMethods.Size(), 7);
+    ASSERT_EQ(kStaticMethods.Find("GET / HTTP/1.1"), std::set<size_t>({0, 4, 5}));
+    ASSERT_EQ(kStaticMethods.Find("xPOSTPUTHEAD"), std::set<size_t>({1, 2, 3}));
+    ASSERT_EQ(kStaticMethods.Find("HTTP/1.0 GE"), std::set<size_t>());
+    ASSERT_EQ(kStaticMethods.Find(""), std::set<size_t>());
+
+    std::vector<std::pair<size_t, size_t>> matches;
+    kStaticMethods.Scan("GETHEAD", 7, [&](size_t index, size_t end) {
+        matches.push_back({index, end});
+    });
+    ASSERT_EQ(matches, (std::vector<std::pair<size_t, size_t>>{{0, 3}, {5, 3}, {3, 7}}));
+}
+
+TEST (StaticAho, RandomTests) {
+    static constexpr auto ps = MakeStaticAho("ab", "bab", "aab", "b", "abba", "baaab", "bbbbbb", "a", "abababab");
+    const char * patterns[] = {"ab", "bab", "aab", "b", "abba", "baaab", "bbbbbb", "a", "abababab"};
+
+    for (int i = 0; i < 100; ++i) {
+        string text(rand() % 20, 'a');
+        for (char& c: text) {
+            c = 'a' + rand() % 2;
+        }
+
+        std::set<size_t> res;
+        for (size_t j = 0; j < 9; ++j) {
+            if (text.find(patterns[j]) != string::npos) {
+                res.insert(j);
+            }
+        }
+
+        ASSERT_EQ(ps.Find(text), res);
+    }
+}
+
+// more than 64 patterns take two words of the outputs
+TEST (StaticAho, ManyPatternsTest) {
+    static constexpr auto ps = MakeStaticAho(
+        "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7", "a8", "a9", "b0", "b1", "b2", "b3", "b4", "b5", "b6", "b7", "b8", "b9",
+        "c0", "c1", "c2", "c3", "c4", "c5", "c6", "c7", "c8", "c9", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "d8", "d9",
+        "e0", "e1", "e2", "e3", "e4", "e5", "e6", "e7", "e8", "e9", "f0", "f1", "f2", "f3", "f4", "f5", "f6", "f7", "f8", "f9",
+        "g0", "g1", "g2", "g3", "g4", "g5", "g6", "g7", "g8", "g9", "0");
+
+    ASSERT_EQ(ps.Find("a0xg9"), std::set<size_t>({0, 69, 70}));
+    ASSERT_EQ(ps.Find("f3g"), std::set<size_t>({53}));
+}
+
+TEST (FlatAho, ManualTests) {
+    manualTest<FlatAhoSearch>();
+}
+
+TEST (FlatAho, RandomTests) {
+    randomTest<FlatAhoSearch>();
+}
+
+TEST (FlatAho, VectoredTest) {
+    vectoredTest<FlatAhoSearch>();
+}
+
+TEST (FlatAho, WorstCaseTest) {
+    WorstCaseTest<FlatAhoSearch>();
+}
+
+TEST (FlatAhoCompact16, ManualTests) {
+    manualTest<FlatAhoCompact16>();
+}
+
+TEST (FlatAhoCompact16, RandomTests) {
+    randomTest<FlatAhoCompact16>();
+}
+
+TEST (FlatAhoCompact16, VectoredTest) {
+    vectoredTest<FlatAhoCompact16>();
+}
+
+TEST (FlatAho, MemoryTest) {
+    memoryTest<FlatAhoSearch>();
+}
+
+TEST (FlatAho, SinksTest) {
+    FlatAho<int> ps;
+    ps.Insert("he", 2, 0);
+    ps.Insert("she", 3, 1);
+    ps.Insert("his", 3, 2);
+    ps.Insert("hers", 4, 3);
+    ps.Build();
+
+    const char * text = "ushershehis";
+
+    CountSink count;
+    ps.Scan(text, strlen(text), count);
+    ASSERT_EQ(count.Result(), 6);
+
+    BitsetSink<4> bits;
+    ps.Scan(text, strlen(text), bits);
+    ASSERT_EQ(bits.Result().to_string(), "1111");
+
+    // the scan stops at the first match of "she"
+    std::vector<std::pair<int, size_t>> matches;
+    auto untilShe = MakeCallbackSink([&](int data, size_t end) {
+        matches.push_back({data, end});
+        return data == 1;
+    });
+    ps.Scan(text, strlen(text), untilShe);
+    ASSERT_EQ(matches, (std::vector<std::pair<int, size_t>>{{1, 4}}));
+
+    SetSink<int> set(2);
+    ps.Scan(text, strlen(text), set);
+    ASSERT_EQ(set.Result(), std::set<int>({0, 1}));
+
+    // Find of PolicySearch stops when the distinct data are found, "she" and "hers" share theirs
+    FlatAhoSearch<int> shared;
+    ASSERT_TRUE(shared.Insert("she", 0));
+    ASSERT_TRUE(shared.Insert("hers", 0));
+    shared.Build();
+    ASSERT_EQ(shared.Size(), 2);
+    ASSERT_EQ(shared.Engine().Distinct(), 1);
+    ASSERT_EQ(shared.Find(text), std::set<int>({0}));
+}
+
+TEST (FlatAho, AlphabetTest) {
+    FlatAho<int, CompactAlphabet<AsciiCaselessAlphabet>, uint8_t> ps;
+    ASSERT_TRUE(ps.Insert("Get", 3, 0));
+    ASSERT_TRUE(ps.Insert("et/", 3, 1));
+    ps.Build();
+
+    // the root and 6 states by 5 columns: "g", "e", "t", "/" and the other bytes
+    ASSERT_EQ(ps.States(), 7);
+
+    SetSink<int> set(ps.Size());
+    ps.Scan("xgET/", 5, set);
+    ASSERT_EQ(set.Result(), std::set<int>({0, 1}));
+
+    // the states of uint8_t are less than 255: the root and 6 + 248 states of the patterns
+    ASSERT_FALSE(ps.Insert(std::string(250, 'a').c_str(), 250, 2));
+    ASSERT_TRUE(ps.Insert(std::string(248, 'a').c_str(), 248, 2));
+}
+
+TEST (ScanStats, ThreadsTest) {
+    ResetScanStats();
+
+    ScanStats stats;
+    stats.bytes = 10;
+    stats.matches = 1;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&stats]() {
+            AddScanStats(stats);
+            AddScanStats(stats);
+            ASSERT_EQ(ThreadScanStats().bytes, 20);
+        });
+    }
+
+    for (std::thread& t: threads) {
+        t.join();
+    }
+
+    // the counters of the exited threads are kept
+    AddScanStats(stats);
+    ASSERT_EQ(ThreadScanStats().bytes, 10);
+    ASSERT_EQ(TotalScanStats().bytes, 90);
+    ASSERT_EQ(TotalScanStats().matches, 9);
+
+    ResetScanStats();
+    ASSERT_EQ(TotalScanStats().bytes, 0);
+}
+
+#ifdef SCAN_STATS
+TEST (ScanStats, AhoTest) {
+    Aho<int> ps;
+    ps.Insert("abcd", 0);
+    ps.Insert("bcd", 1);
+    ps.Insert("qqq", 2);
+    ps.Build();
+
+    ResetScanStats();
+    ASSERT_EQ(ps.Find("xabcdx"), std::set<int>({0, 1}));
+
+    // "x" and the last "x" leave the automaton in the root by the failure transitions,
+    // "abcd" reports "bcd" by its output link
+    ScanStats stats = ThreadScanStats();
+    ASSERT_EQ(stats.scans, 1);
+    ASSERT_EQ(stats.bytes, 6);
+    ASSERT_EQ(stats.rootBytes, 2);
+    ASSERT_EQ(stats.linkSteps, 2);
+    ASSERT_EQ(stats.outputLinks, 1);
+    ASSERT_EQ(stats.matches, 2);
+    ASSERT_EQ(stats.earlyExits, 0);
+
+    ResetScanStats();
+    ps.Find("abcdqqqabcd");
+    ASSERT_EQ(ThreadScanStats().bytes, 7);
+    ASSERT_EQ(ThreadScanStats().earlyExits, 1);
+}
+
+TEST (ScanStats, TrieSearchTest) {
+    TrieSearch<int> ps;
+    ps.Insert("abc", 0);
+    ps.Insert("x", 1);
+
+    ResetScanStats();
+    ps.Find("yabx");
+
+    // the walk from "a" reads "b" and "x", the walks from "y" and "b" stop at their first byte
+    ScanStats stats = ThreadScanStats();
+    ASSERT_EQ(stats.bytes, 4);
+    ASSERT_EQ(stats.rootBytes, 2);
+    ASSERT_EQ(stats.linkSteps, 1);
+    ASSERT_EQ(stats.matches, 1);
+}
+
+TEST (ScanStats, HyperscanTest) {
+    Hyperscan<int> ps;
+    ps.Insert("abc", 0);
+    ps.Insert("bc", 1);
+    ps.Build();
+
+    ResetScanStats();
+    ps.Find("xabcx");
+    ASSERT_EQ(ThreadScanStats().scans, 1);
+    ASSERT_EQ(ThreadScanStats().bytes, 5);
+    ASSERT_EQ(ThreadScanStats().matches, 2);
+}
+#endif
+
+TEST (PerfCounters, ScanTest) {
+    Aho<int> ps;
+    ps.Insert("abc", 0);
+    ps.Build();
+
+    std::string text(1 << 20, 'a');
+    for (char& c: text) {
+        c = 'a' + rand() % 4;
+    }
+
+    PerfCounters counters;
+    counters.Start();
+    ASSERT_EQ(ps.Find(text), std::set<int>({0}));
+    counters.Stop();
+
+    if (!counters.Valid()) {
+        ASSERT_EQ(counters.CacheMisses(), 0);
+        ASSERT_EQ(counters.BranchMisses(), 0);
+    }
+}
+
+TEST (HitProfile, AhoTest) {
+    Aho<int> ps;
+    ps.Insert("abc", 0);
+    ps.Insert("xyz", 1);
+    ps.Insert("bc", 2);
+    ps.Build();
+
+    auto start = std::chrono::system_clock::now();
+    ps.StartProfile(1);
+    ps.Find("abc");
+    ps.Find("xabcx");
+    ps.Find("qxyz");
+    ps.StopProfile();
+    ps.Find("abc");
+
+    std::map<int, PatternHits> hits = ps.PatternProfile();
+    ASSERT_EQ(ps.ProfiledScans(), 3);
+    ASSERT_EQ(hits.size(), 3);
+    ASSERT_EQ(hits[0].hits, 2);
+    ASSERT_EQ(hits[1].hits, 1);
+    ASSERT_EQ(hits[2].hits, 2);
+    ASSERT_GE(hits[0].lastHit, start);
+
+    // the root is 0, it's visited by "q", the texts make 12 transitions
+    std::vector<uint64_t> visits = ps.StateProfile();
+    ASSERT_EQ(visits.size(), ps.States());
+    ASSERT_EQ(std::accumulate(visits.begin(), visits.end(), uint64_t(0)), 12);
+    ASSERT_EQ(visits[0], 1);
+
+    // the states are renumbered
+    ps.Build();
+    ASSERT_TRUE(ps.StateProfile().empty());
+    ASSERT_EQ(ps.PatternProfile().size(), 3);
+
+    ps.ResetProfile();
+    ASSERT_EQ(ps.ProfiledScans(), 0);
+    ASSERT_TRUE(ps.PatternProfile().empty());
+}
+
+TEST (HitProfile, SamplingTest) {
+    Aho<int> ps;
+    ps.Insert("abc", 0);
+    ps.Build();
+
+    ps.StartProfile(4);
+    for (int i = 0; i < 16; ++i) {
+        ps.Find("abc");
+    }
+
+    ASSERT_EQ(ps.ProfiledScans(), 4);
+    ASSERT_EQ(ps.PatternProfile()[0].hits, 4);
+
+    // every profile counts its own scans of the thread
+    Aho<int> other;
+    other.Insert("abc", 1);
+    other.Build();
+
+    ps.ResetProfile();
+    ps.StartProfile(2);
+    other.StartProfile(2);
+    for (int i = 0; i < 8; ++i) {
+        ps.Find("abc");
+        other.Find("abc");
+    }
+
+    ASSERT_EQ(ps.ProfiledScans(), 4);
+    ASSERT_EQ(other.ProfiledScans(), 4);
+}
+
+TEST (HitProfile, MultiThreadingTest) {
+    Aho<int> ps;
+    ps.Insert("abc", 0);
+    ps.Insert("bcd", 1);
+    ps.Build();
+    ps.StartProfile(1);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&ps]() {
+            for (int j = 0; j < 100; ++j) {
+                ASSERT_EQ(ps.Find("abcd"), std::set<int>({0, 1}));
+            }
+        });
+    }
+
+    for (std::thread& t: threads) {
+        t.join();
+    }
+
+    // the buffers of the threads are merged
+    ASSERT_EQ(ps.ProfiledScans(), 400);
+    ASSERT_EQ(ps.PatternProfile()[0].hits, 400);
+    ASSERT_EQ(ps.StateProfile()[0], 0);
+}
+
+TEST (HitProfile, HybridBlockTest) {
+    AhoHybridSmallBlock<int> ps;
+    Aho<int> dense;
+    for (const char * pattern: {"abcd", "bcd", "cxx", "zzz"}) {
+        ps.Insert(pattern, pattern[0]);
+        dense.Insert(pattern, pattern[0]);
+    }
+    ps.Build();
+    dense.Build();
+
+    // the hot states are "a", "ab", "abc" and "abcd", the failure link "bc" of "abc" gets no row
+    ps.StartProfile(1);
+    ps.Find("abcdabcdabcd");
+    ps.StopProfile();
+    ps.Build();
+    ASSERT_EQ(ps.Rows(), 4);
+
+    for (int i = 0; i < 1000; ++i) {
+        std::string text;
+        for (int j = 0; j < 10; ++j) {
+            text.push_back("abcdxz"[rand() % 6]);
+        }
+
+        ASSERT_EQ(ps.Find(text), dense.Find(text));
+    }
+}
+
+TEST (TrieSearch, ManualTests) {
+    manualTest<TrieSearch>();
+}
+
+TEST (TrieSearch, SharedDataTest) {
+    sharedDataTest<TrieSearch>();
+}
+
+TEST (TrieSearch, MemoryTest) {
+    memoryTest<TrieSearch>();
+}
+
+TEST (TrieSearch, VectoredTest) {
+    vectoredTest<TrieSearch>();
+}
+
+TEST (TrieSearch, CaselessTest) {
+    caselessTest<TrieSearch>();
+}
+
+TEST (TrieSearch, CaselessRandomTest) {
+    caselessRandomTest<TrieSearch>();
+}
+
+TEST (TrieSearch, PositionTest) {
+    positionTest<TrieSearch>();
+}
+
+TEST (TrieSearch, PositionRandomTest) {
+    positionRandomTest<TrieSearch>();
+}
+
+// the checked caseless rules are the same rule in any case like the unchecked ones
+TEST (TrieSearch, CaselessCheckedTest) {
+    const PatternOptions word(PatternOptions::kCaseless | PatternOptions::kWordBoundary);
+    const PatternOptions caseless(PatternOptions::kCaseless);
+    TrieSearchTruncated<int> ps;
+
+    ASSERT_TRUE(ps.Insert("Host", 1, word));
+    ASSERT_FALSE(ps.Insert("HOST", 1, word));
+    ASSERT_TRUE(ps.Insert("User-Agent", 2, caseless));
+    ASSERT_FALSE(ps.Insert("user-agent", 2, caseless));
+    ASSERT_EQ(ps.Size(), 2);
+    ps.Build();
+
+    {
+        std::set<int> res{1, 2};
+        ASSERT_EQ(ps.Find("host: x\r\nUSER-AGENT: y"), res);
+    }
+
+    ASSERT_TRUE(ps.Delete("host", 1, word));
+    ASSERT_FALSE(ps.Delete("Host", 1, word));
+    ASSERT_TRUE(ps.Delete("USER-agent", 2, caseless));
+    ASSERT_EQ(ps.Size(), 0);
+}
+
+TEST (TrieSearch, RandomTests) {
+    randomTest<TrieSearch>();
+}
+
+TEST (TrieSearch, WorstCaseTest) {
+    WorstCaseTest<TrieSearch>();
+}
+
+TEST (TrieSearch, WorstCaseNotMatchTest) {
+    WorstCaseTest<TrieSearch>(true);
+}
+
+TEST (TrieSearchTruncated, ManualTests) {
+    manualTest<TrieSearchTruncated>();
+}
+
+TEST (TrieSearchTruncated, RandomTests) {
+    randomTest<TrieSearchTruncated>(1000, 100, 10, 12, 2);
+}
+
+TEST (TrieSearchTruncated, CaselessRandomTest) {
+    caselessRandomTest<TrieSearchTruncated>(1000, 100, 12);
+}
+
+TEST (TrieSearchTruncated, PositionRandomTest) {
+    positionRandomTest<TrieSearchTruncated>(100, 50, 8);
 }
 
 #endif